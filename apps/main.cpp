@@ -51,16 +51,22 @@ int main(int argc, char** argv) {
         data.raw.width = 640;
         data.raw.height = 480;
         data.raw.data.resize(static_cast<size_t>(data.raw.width) * data.raw.height, 512);
+        data.sourceHash = hashRawContent(data.raw); // as the loaders do
     }
 
     // Optional: parse viewport / tile size / LOD
     bool hasViewport = false;
     int vx = 0, vy = 0, vw = 0, vh = 0;
     int tileSize = 256;
+    bool fixedTile = false; // --tile N
+    std::filesystem::path calibrateFile;
     int lod = 0;
     bool useGpu = false;
     int gpuDebug = 0; // 0=real,1=coords,2=raw
     bool gpuSynth = false;
+    bool numa = false;
+    bool color = false;
+    bool printPlan = false;
     for (int i = 2; i < argc; ++i) {
         if (std::strcmp(argv[i], "--viewport") == 0 && i + 4 < argc) {
             int x, y, w, h;
@@ -72,8 +78,11 @@ int main(int argc, char** argv) {
             }
         } else if (std::strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
             int ts;
-            if (parseInt(argv[i+1], ts) && ts > 0) { tileSize = ts; i += 1; continue; }
-            std::cerr << "Invalid --tile N\n"; return 2;
+            if (std::strcmp(argv[i+1], "auto") == 0) { tileSize = 0; fixedTile = false; i += 1; continue; }
+            if (parseInt(argv[i+1], ts) && ts > 0) { tileSize = ts; fixedTile = true; i += 1; continue; }
+            std::cerr << "Invalid --tile N|auto\n"; return 2;
+        } else if (std::strcmp(argv[i], "--calibrate") == 0 && i + 1 < argc) {
+            calibrateFile = argv[i+1]; i += 1; continue;
         } else if (std::strcmp(argv[i], "--lod") == 0 && i + 1 < argc) {
             int L;
             if (parseInt(argv[i+1], L) && L >= 0) { lod = L; i += 1; continue; }
@@ -87,8 +96,19 @@ int main(int argc, char** argv) {
             i += 1; continue;
         } else if (std::strcmp(argv[i], "--gpu-synth") == 0) {
             gpuSynth = true; continue;
+        } else if (std::strcmp(argv[i], "--numa") == 0) {
+            numa = true; continue;
+        } else if (std::strcmp(argv[i], "--color") == 0) {
+            color = true; continue;
+        } else if (std::strcmp(argv[i], "--plan") == 0) {
+            printPlan = true; continue;
         }
     }
+    if (!calibrateFile.empty()) {
+        // Calibration picks the tile size; it cannot be combined with a fixed one.
+        if (fixedTile) { std::cerr << "--calibrate cannot be combined with --tile N\n"; return 2; }
+        tileSize = 0;
+    }
 
     // Add an optional PRE_DEMOSAIC plugin (e.g., denoise)
     for (size_t i = 0; i < protos.size(); ++i) {
@@ -102,8 +122,9 @@ int main(int argc, char** argv) {
         }
     }
 
-    // Add WhiteBalance (POST_DEMOSAIC_LINEAR) if available, set from meta if present
-    for (size_t i = 0; i < protos.size(); ++i) {
+    // Add WhiteBalance (POST_DEMOSAIC_LINEAR) if available, set from meta if present. The
+    // full-color path applies the camera white balance itself.
+    for (size_t i = 0; i < protos.size() && !color; ++i) {
         if (protos[i].name == "WhiteBalance") {
             auto id = pm.createInstance(i);
             if (id) {
@@ -133,67 +154,74 @@ int main(int argc, char** argv) {
     }
 
     ProcessingPipeline pipeline(pm);
+    const auto mode = color ? rawproc::RenderMode::FullColor : rawproc::RenderMode::GrayscalePreview;
+    pipeline.setNumaAware(numa);
+    pipeline.setUseGpu(useGpu);
+    pipeline.setGpuDebugMode(gpuDebug);
+    pipeline.setGpuSynthetic(gpuSynth);
+    if (printPlan) std::cout << pipeline.executionPlan(data, mode)->describe();
 
     rawproc::RenderRequest req;
-    req.outWidth = static_cast<int>(data.raw.width);
-    req.outHeight = static_cast<int>(data.raw.height);
+    // Render at the mip that exists for --lod; the frame size follows from it.
+    uint32_t frameW = 0, frameH = 0;
+    req.lod = ProcessingPipeline::lodFrameSize(data.raw.width, data.raw.height, lod, frameW, frameH);
+    if (!calibrateFile.empty()) {
+        // Reuse this machine's measurement for the chain, or take one and store it.
+        auto& tuner = pipeline.tileTuner();
+        tuner.load(calibrateFile);
+        if (!tuner.hasCalibration(pipeline.tileInputs(data, req.lod, mode))) {
+            const int ts = pipeline.calibrateTileSize(data, mode, req.lod);
+            std::cout << "Calibrated tile size " << ts << "\n";
+            if (!tuner.save(calibrateFile)) std::cerr << "Failed to write " << calibrateFile << "\n";
+        }
+    }
     req.tileSize = tileSize;
-    req.lod = lod;
+    tileSize = pipeline.resolveTileSize(data, req, mode);
+    req.tileSize = tileSize;
+    std::cout << "Tile size " << tileSize << "\n";
 
     if (hasViewport) {
-        // Compute tiles covering viewport
-        // Viewport is interpreted at the selected LOD
+        // Viewport is interpreted at the selected LOD; the tile query takes LOD-0 coordinates.
         int x0 = std::max(0, vx);
         int y0 = std::max(0, vy);
-        int x1 = std::min<int>(req.outWidth, vx + vw);
-        int y1 = std::min<int>(req.outHeight, vy + vh);
+        int x1 = std::min<int>(static_cast<int>(frameW), vx + vw);
+        int y1 = std::min<int>(static_cast<int>(frameH), vy + vh);
         if (x1 <= x0 || y1 <= y0) {
             std::cerr << "Viewport out of bounds or empty\n"; return 3;
         }
-        int tx0 = x0 / tileSize;
-        int ty0 = y0 / tileSize;
-        int tx1 = (x1 - 1) / tileSize;
-        int ty1 = (y1 - 1) / tileSize;
-        for (int ty = ty0; ty <= ty1; ++ty) {
-            for (int tx = tx0; tx <= tx1; ++tx) req.tiles.push_back({tx, ty, 0});
-        }
+        req.tiles = ProcessingPipeline::tilesForViewport(data.raw.width, data.raw.height, x0 << req.lod, y0 << req.lod,
+                                                         (x1 - x0) << req.lod, (y1 - y0) << req.lod, req.lod, tileSize);
     }
 
-    pipeline.setUseGpu(useGpu);
-    pipeline.setGpuDebugMode(gpuDebug);
-    pipeline.setGpuSynthetic(gpuSynth);
-    auto rgb = pipeline.apply(data, req, rawproc::RenderMode::GrayscalePreview);
-
     ImageExporter ex;
+    ex.setScheduler(pipeline.scheduler());
     // Output: if viewport specified, write cropped image
     std::filesystem::path out = hasViewport ? std::filesystem::path("preview_viewport.png") : std::filesystem::path("preview.png");
     if (hasViewport) {
+        // Only the viewport is allocated; the tiles are written straight into it.
         RgbImageF crop;
         crop.width = static_cast<uint32_t>(vw);
         crop.height = static_cast<uint32_t>(vh);
-        crop.data.resize(static_cast<size_t>(vw) * vh * 3u);
-        int x0 = std::max(0, vx);
-        int y0 = std::max(0, vy);
-        for (int yy = 0; yy < vh; ++yy) {
-            int sy = y0 + yy;
-            if (sy < 0 || sy >= static_cast<int>(rgb.height)) continue;
-            for (int xx = 0; xx < vw; ++xx) {
-                int sx = x0 + xx;
-                if (sx < 0 || sx >= static_cast<int>(rgb.width)) continue;
-                size_t si = (static_cast<size_t>(sy) * rgb.width + sx) * 3u;
-                size_t di = (static_cast<size_t>(yy) * vw + xx) * 3u;
-                crop.data[di+0] = rgb.data[si+0];
-                crop.data[di+1] = rgb.data[si+1];
-                crop.data[di+2] = rgb.data[si+2];
-            }
-        }
+        crop.data.resize(static_cast<size_t>(vw) * vh * 3u, 0.0f);
+        rawproc::RenderTarget target;
+        target.data = crop.data.data();
+        target.stride = static_cast<size_t>(vw) * 3u * sizeof(float);
+        target.width = crop.width;
+        target.height = crop.height;
+        target.originX = std::max(0, vx);
+        target.originY = std::max(0, vy);
+        pipeline.applyInto(data, req, target, mode);
         if (ex.exportPNG(out, crop)) {
             std::cout << "Wrote viewport image to " << out << "\n";
         } else {
             std::cerr << "Failed to write viewport image\n";
         }
     } else {
-        if (ex.exportPNG(out, rgb)) {
+        // Full frame: quantize straight from the rendered tiles on the background writer; further
+        // renders could be issued here while it encodes.
+        auto written = ex.exportAsync(out, pipeline.applyTiles(data, req, mode),
+                                      ExportFormat::PNG);
+        if (written.get()) {
             std::cout << "Wrote preview image to " << out << "\n";
         } else {
             std::cerr << "Failed to write preview image" << "\n";
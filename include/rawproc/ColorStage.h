@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+
+#include "rawproc/ImageTypes.h"
+#include "rawproc/UnifiedRawData.h"
+
+namespace rawproc {
+
+// Built-in linear color stage of the full-color path. White balance, baseline exposure and the
+// camera-to-sRGB matrix are folded into a single 3x3 matrix, so a tile is converted in one pass:
+// out = clamp(m * camera, 0, 1).
+struct LinearColorTransform {
+    float m[3][3] = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+
+    // cam_to_srgb * 2^baseline_exposure * diag(wb / wb[G]).
+    static LinearColorTransform fromMeta(const CameraMeta& meta);
+};
+
+// In place on `pixels` interleaved RGB floats; NaN becomes 0.
+void applyLinearColor(float* rgb, size_t pixels, const LinearColorTransform& t);
+
+// Bilinear demosaic of the 2x2 Bayer mosaic `raw` (site (x, y) has color
+// meta.cfa[(y + phaseY) & 1][(x + phaseX) & 1]) for the region (x0, y0, w, h), written tightly
+// packed into `out` (w * h * 3 floats). Samples are normalized on the fly:
+// (v - black - meta.cfa_black[site]) * invNorm, not clipped. Neighbours outside `raw` are
+// skipped, so the region should keep a one-pixel margin where real data exists. Without a Bayer
+// mosaic (meta.bayer false) every channel gets the normalized sample.
+void demosaicBilinear(const RawImage& raw, int phaseX, int phaseY, const CameraMeta& meta,
+                      float black, float invNorm, int x0, int y0, int w, int h, float* out);
+
+} // namespace rawproc
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rawproc/IProcessingPlugin.h"
+#include "rawproc/PluginManager.h"
+#include "rawproc/UnifiedRawData.h"
+
+namespace rawproc {
+
+enum class RenderMode { GrayscalePreview, FullColor };
+
+// A plugin chain compiled for one render mode: the instances of data.history bucketed by stage
+// in execution order, with the tile aprons, the chain hashes and the per-tile buffer needs
+// resolved up front, so tiles do not go back to the plugin manager or the plugins' virtual
+// getters. Plans are immutable and shared by concurrent renders; ProcessingPipeline keeps the
+// last one per mode and rebuilds it when stateKey() changes (history or a parameter state).
+struct ExecutionPlan {
+    struct Step {
+        size_t index = 0; // position in data.history
+        PluginManager::InstanceId instanceId = 0;
+        std::shared_ptr<IProcessingPlugin> plugin;
+        std::string name;
+        ProcessingStage stage = ProcessingStage::PRE_DEMOSAIC;
+        int radius = 0;        // kernelRadiusPx()
+        int margin = 0;        // around the inner tile, where this step's output must be valid
+        bool writesRaw = true;
+        int analysisLod = -1;  // LOD of its global analysis, -1 if it has none
+        size_t stateHash = 0;
+        size_t prefixHash = 0; // params hash of the chain up to and including this step
+    };
+
+    RenderMode mode = RenderMode::GrayscalePreview;
+    size_t key = 0;        // stateKey() the plan was built for
+    size_t historySize = 0;
+    std::vector<Step> steps; // history order; missing instances are left out
+    // Indices into steps for each ProcessingStage that runs in this mode, in execution order.
+    std::vector<size_t> stages[4];
+    // Tiles run the PRE_DEMOSAIC steps, the demosaic (or gray conversion), the
+    // POST_DEMOSAIC_LINEAR steps (full color only) and the FINALIZE steps, each in history
+    // order. A neighbourhood stage needs its radius of valid input around what the stages after
+    // it need, so margins add up from the end of the chain.
+    int rawApron = 0; // margin of the raw tile extracted around the inner tile
+    int rgbApron = 0; // margin of the RGB buffer the demosaic writes
+    size_t paramsHash = 0; // plugin identities, stages and parameter states of the whole chain
+    int analysisLod = -1;  // the coarsest LOD any step analyzes at, -1 if none
+    // Working set per tile pixel: one 16-bit copy per raw step plus the source, and the float RGB
+    // tile (what TileTuner::Inputs::bytesPerPixel expects).
+    size_t bytesPerPixel = 0;
+
+    // Cheap fingerprint of (history, parameter states, mode): one lookup and stateHash() call
+    // per step.
+    static size_t stateKey(PluginManager& pm, const std::vector<ProcessingStep>& history, RenderMode mode);
+    static std::shared_ptr<const ExecutionPlan> build(PluginManager& pm, const std::vector<ProcessingStep>& history,
+                                                      RenderMode mode);
+
+    const std::vector<size_t>& stage(ProcessingStage s) const { return stages[static_cast<int>(s)]; }
+
+    // Text dump for diagnostics: a header line, then one "<index> <stage> <name> ..." line per
+    // step in execution order.
+    std::string describe() const;
+};
+
+} // namespace rawproc
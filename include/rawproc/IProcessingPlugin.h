@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "rawproc/ImageTypes.h"
+#include "rawproc/TaskScheduler.h"
 
 namespace rawproc {
 
@@ -40,6 +41,33 @@ struct ParameterDesc {
     ParamValue defaultValue = 0.0f;
 };
 
+// Plugin-defined result of a global analysis pass (see IProcessingPlugin::analyze_raw/_rgb).
+struct AnalysisResult {
+    virtual ~AnalysisResult() = default;
+};
+
+// Rectangle in pixel coordinates of the image handed to a plugin.
+struct PixelRegion {
+    int x = 0, y = 0;
+    int width = 0, height = 0;
+};
+
+// Per-invocation context handed to plugins by the pipeline.
+struct ProcessContext {
+    // Host worker pool for internal parallelism; may be null (then run serially).
+    ITaskScheduler* scheduler = nullptr;
+    // Level of detail being rendered (0 = full resolution).
+    int lod = 0;
+    // This plugin's global analysis for the current source/parameters, or null if it has none.
+    const AnalysisResult* analysis = nullptr;
+    // Part of the image the later stages read. The rest is apron that only this step needs as
+    // input and may be left unprocessed. Empty (width 0) means the whole image.
+    PixelRegion region;
+    // Frame position (at `lod`) of pixel (0, 0) of the image handed to the plugin, for plugins
+    // that edit fixed places. Tiles include their apron; whole images sit at 0, 0.
+    int originX = 0, originY = 0;
+};
+
 class IProcessingPlugin {
 public:
     virtual ~IProcessingPlugin() = default;
@@ -57,10 +85,39 @@ public:
     virtual void process_raw(RawImage& raw) { (void)raw; }
     virtual void process_rgb(RgbImageF& rgb) { (void)rgb; }
 
+    // Context-aware entry points called by the pipeline. Plugins that parallelize internally
+    // override these and use ctx.scheduler; the defaults forward to the plain versions above.
+    virtual void process_raw(RawImage& raw, const ProcessContext& ctx) { (void)ctx; process_raw(raw); }
+    virtual void process_rgb(RgbImageF& rgb, const ProcessContext& ctx) { (void)ctx; process_rgb(rgb); }
+
+    // Optional two-phase contract for global operators (auto-exposure, histogram equalization,
+    // guided filters...): "analyze globally, then apply per tile". When wantsGlobalAnalysis()
+    // is true, the pipeline runs the chain on a reduced image at analysisLod() and calls the
+    // analyze function matching the plugin's stage once, before any tile. The result is cached
+    // by source and parameter hash and handed to every tile through ProcessContext::analysis.
+    // The raw image passed to analyze_raw may be a view; read it through row().
+    virtual bool wantsGlobalAnalysis() const { return false; }
+    virtual int analysisLod() const { return 3; }
+    virtual std::shared_ptr<const AnalysisResult> analyze_raw(const RawImage& raw, const ProcessContext& ctx) { (void)raw; (void)ctx; return nullptr; }
+    virtual std::shared_ptr<const AnalysisResult> analyze_rgb(const RgbImageF& rgb, const ProcessContext& ctx) { (void)rgb; (void)ctx; return nullptr; }
+
     // Optional: kernel radius in pixels for the plugin at its stage, used to compute tile aprons.
-    // Default 0 means no neighborhood dependency.
+    // Default 0 means no neighborhood dependency. Radii of stacked stages add up, so each one
+    // is given exactly the valid input it needs (see ProcessContext::region).
     virtual size_t kernelRadiusPx() const { return 0; }
 
+    // Optional: false when process_raw only reads the image (statistics, probes). Such steps may
+    // be handed a read-only view of the source (RawImage::isView()) and must read it through
+    // row(); tiles get a private copy of their raw pixels only once a step writes them.
+    virtual bool writesRaw() const { return true; }
+
+    // Optional, for local edits (spot healing, masked adjustments): state that only affects part
+    // of the image may be left out of stateHash(). After such a change the plugin returns true
+    // once, with the union of the changed areas in LOD-0 image coordinates, and the pipeline
+    // drops only the cached tiles that depend on it (apron included, at every LOD) before its
+    // next render.
+    virtual bool takeDirtyRegion(PixelRegion& region) { (void)region; return false; }
+
     // Optional: a stable hash of current parameter state for caching/invalidation.
     // Default 0 (treated as no state impact).
     virtual size_t stateHash() const { return 0; }
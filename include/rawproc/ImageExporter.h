@@ -1,19 +1,107 @@
 #pragma once
 #include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
 
 #include "rawproc/ImageTypes.h"
+#include "rawproc/PngEncoder.h"
+#include "rawproc/Quantize.h"
+#include "rawproc/TaskScheduler.h"
+#include "rawproc/TiffEncoder.h"
 
 namespace rawproc {
 
+enum class ExrCompression { None, Zip, Piz };
+
+struct ExrOptions {
+    ExrCompression compression = ExrCompression::Zip;
+    bool half = true;  // 16-bit half samples; false writes 32-bit float
+    int tileSize = 64; // EXR tile edge in pixels (clamped to the image)
+};
+
+// Target format for queued exports.
+enum class ExportFormat { PNG, JPG, PNG16, TIFF, PPM, EXR };
+
 class ImageExporter {
 public:
+    ImageExporter();
+    ~ImageExporter();
+
     // Export 8-bit PNG/JPG using stb if available; otherwise falls back to PPM.
     bool exportPNG(const std::filesystem::path& path, const RgbImageF& img);
     bool exportJPG(const std::filesystem::path& path, const RgbImageF& img, int quality = 90);
+    // Same, quantizing straight from rendered tiles (no assembled float frame needed).
+    bool exportPNG(const std::filesystem::path& path, const RgbTileSet& tiles);
+    bool exportJPG(const std::filesystem::path& path, const RgbTileSet& tiles, int quality = 90);
+
+    // Binary PNM for lossless intermediate dumps: RGB as P6 with 8 or 16 bits per sample
+    // (maxval 255 / 65535), raw sensor data as 16-bit P5. Always available.
+    bool exportPPM(const std::filesystem::path& path, const RgbImageF& img, int bitDepth = 8);
+    bool exportPGM(const std::filesystem::path& path, const RawImage& raw);
+
+    // High-bit-depth deliverables: 16-bit RGB PNG, and RGB TIFF with 16 (or 8) bits per sample,
+    // stored or Deflate-compressed. Rows are quantized band by band in parallel and streamed to the
+    // encoder, so no full-frame integer copy is made. Without zlib, PNG falls back to a 16-bit PPM
+    // and TIFF is written uncompressed.
+    bool exportPNG16(const std::filesystem::path& path, const RgbImageF& img);
+    bool exportTIFF(const std::filesystem::path& path, const RgbImageF& img, int bitDepth = 16);
+    void setTiffOptions(const TiffOptions& opt) { tiff_ = opt; }
 
-    // Export EXR using TinyEXR if available; returns false if unsupported.
+    // Export tiled EXR using TinyEXR if available; returns false if unsupported. Tile planes are
+    // prepared in parallel (from the frame or directly from rendered tiles) and compressed on
+    // TinyEXR's worker threads.
     bool exportEXR(const std::filesystem::path& path, const RgbImageF& img);
+    bool exportEXR(const std::filesystem::path& path, const RgbTileSet& tiles);
+    void setExrOptions(const ExrOptions& opt) { exr_ = opt; }
+
+    // Ordered dithering for 8-bit outputs (off by default).
+    void setDither(bool on) { quant_.dither = on; }
+    // PNG compression level / filter heuristic, and band-parallel deflate (used when zlib is
+    // available; otherwise stb applies the level and forced filter on a single thread).
+    void setPngOptions(const PngOptions& opt) { png_ = opt; }
+
+    // Runs the parallel parts (quantization, deflate bands, EXR tiles) on `sched`, e.g. the
+    // pipeline's workers (ProcessingPipeline::scheduler()), instead of a pool of the exporter's
+    // own, so exports overlapping renders do not oversubscribe the cores. `sched` must outlive
+    // the exporter; call before the first export.
+    void setScheduler(ITaskScheduler& sched);
+
+    // Background export queue, so rendering the next frame can overlap with encoding this one.
+    // Jobs take ownership of their image and run on dedicated writer threads (encoders still
+    // fan out on the exporter pool) with the options current at submission. Submitting blocks
+    // while `maxPending` jobs are already waiting, which bounds the images held in memory to
+    // maxPending + writers. The future reports the same result as the synchronous call; `onDone`,
+    // if given, runs on the writer thread right before it is fulfilled. Tile sets are exported
+    // straight from the tiles for PNG/JPG/EXR and assembled into a frame for the other formats.
+    std::future<bool> exportAsync(std::filesystem::path path, RgbImageF img, ExportFormat fmt,
+                                  std::function<void(bool)> onDone = {});
+    std::future<bool> exportAsync(std::filesystem::path path, RgbTileSet tiles, ExportFormat fmt,
+                                  std::function<void(bool)> onDone = {});
+    // Writer threads and queue bound; takes effect when the queue is started by the first
+    // exportAsync (defaults: 1 writer, 2 pending).
+    void setAsyncLimits(size_t writers, size_t maxPending);
+    // Blocks until every queued export has finished. The destructor also drains the queue.
+    void waitIdle();
+
+private:
+    struct AsyncQueue;
+
+    bool run(ExportFormat fmt, const std::filesystem::path& path, const RgbImageF& img);
+    bool write8(const std::filesystem::path& path, const PixelBuffer<uint8_t>& buf, uint32_t w, uint32_t h,
+                bool jpg, int quality);
+    ITaskScheduler& pool();
+
+    QuantizeOptions quant_;
+    PngOptions png_;
+    ExrOptions exr_;
+    TiffOptions tiff_;
+    // setScheduler()'s, or a pool created on first use; shared with the async writers
+    std::shared_ptr<ITaskScheduler> pool_;
+    size_t asyncWriters_ = 1;
+    size_t asyncPending_ = 2;
+    std::unique_ptr<AsyncQueue> async_; // declared last: drained before the pool goes away
 };
 
 } // namespace rawproc
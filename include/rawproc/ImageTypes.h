@@ -1,23 +1,94 @@
 #pragma once
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace rawproc {
 
+// Allocator whose value-less construct() default-initializes, so resize(n) on a pixel buffer
+// does not zero-fill. This lets large buffers be first-touched (and thus placed on the right
+// NUMA node) by the worker threads that fill them. resize(n, v) still initializes as usual.
+template <class T, class A = std::allocator<T>>
+struct DefaultInitAllocator : A {
+    using A::A;
+    DefaultInitAllocator() = default;
+    template <class U>
+    struct rebind {
+        using other = DefaultInitAllocator<U, typename std::allocator_traits<A>::template rebind_alloc<U>>;
+    };
+    template <class U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value) {
+        ::new (static_cast<void*>(p)) U;
+    }
+    template <class U, class... Args>
+    void construct(U* p, Args&&... args) {
+        std::allocator_traits<A>::construct(static_cast<A&>(*this), p, std::forward<Args>(args)...);
+    }
+};
+
+template <class T>
+using PixelBuffer = std::vector<T, DefaultInitAllocator<T>>;
+
 // Minimal image buffers to keep core independent from heavy libs.
 struct RawImage {
-    // Simple Bayer-like single channel buffer; 16-bit per pixel.
-    std::vector<uint16_t> data;
+    // Simple Bayer-like single channel buffer; 16-bit per pixel. Compact (stride == width)
+    // unless the image is a view, in which case it is empty.
+    PixelBuffer<uint16_t> data;
     uint32_t width = 0;
     uint32_t height = 0;
+    // Zero-copy view into a buffer owned elsewhere (e.g. the decoder's raw plate, margins
+    // included): row y starts at view + y * stride, and `owner` keeps the buffer alive. Views are
+    // read-only; copies share the buffer. Call makeCompact() before modifying pixels.
+    std::shared_ptr<const void> owner;
+    const uint16_t* view = nullptr;
+    size_t stride = 0; // in pixels
     // CFA pattern, metadata placeholders can be added later.
+
+    bool isView() const { return view != nullptr; }
+    const uint16_t* row(uint32_t y) const {
+        return view ? view + y * stride : data.data() + static_cast<size_t>(y) * width;
+    }
+    size_t rowStride() const { return view ? stride : width; }
+    // Copies a view into compact `data` and drops the reference to the shared buffer.
+    void makeCompact() {
+        if (!view) return;
+        data.resize(static_cast<size_t>(width) * height);
+        for (uint32_t y = 0; y < height; ++y) std::copy(row(y), row(y) + width, data.data() + static_cast<size_t>(y) * width);
+        view = nullptr;
+        stride = 0;
+        owner.reset();
+    }
 };
 
 struct RgbImageF {
     // Interleaved RGB, float per channel.
-    std::vector<float> data; // size = width*height*3
+    PixelBuffer<float> data; // size = width*height*3
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// One rendered tile of an RGB frame. The buffer is shared (e.g. with the pipeline tile cache)
+// and must not be modified.
+struct RgbTile {
+    int x = 0; // pixel offset of the tile in the frame at `lod`
+    int y = 0;
+    int lod = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::shared_ptr<const PixelBuffer<float>> data; // interleaved RGB, width*height*3
+};
+
+// A frame kept as its tiles, so consumers (exporters) can read tile buffers directly instead of
+// an assembled full-frame copy. Pixels not covered by any tile are black.
+struct RgbTileSet {
     uint32_t width = 0;
     uint32_t height = 0;
+    std::vector<RgbTile> tiles;
 };
 
 } // namespace rawproc
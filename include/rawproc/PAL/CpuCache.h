@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace rawproc::pal {
+
+// Data cache hierarchy of the first CPU. On Linux this is read from sysfs
+// (/sys/devices/system/cpu/cpu0/cache/index*); elsewhere, or for levels sysfs does not report,
+// typical desktop sizes are assumed.
+struct CpuCacheInfo {
+    size_t l1d = 32 * 1024;
+    size_t l2 = 1024 * 1024;
+    size_t l3 = 8 * 1024 * 1024;
+    // Logical CPUs sharing each level (1 = private).
+    unsigned l2SharedBy = 1;
+    unsigned l3SharedBy = 1;
+
+    // Per-CPU share of a level.
+    size_t l2PerCpu() const { return l2 / (l2SharedBy ? l2SharedBy : 1); }
+    size_t l3PerCpu() const { return l3 / (l3SharedBy ? l3SharedBy : 1); }
+
+    static CpuCacheInfo detect();
+};
+
+// Parses a sysfs cache size such as "48K", "2048K" or "32M" into bytes (0 if malformed).
+size_t parseCacheSize(const std::string& s);
+
+} // namespace rawproc::pal
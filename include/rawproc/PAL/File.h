@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+
+namespace rawproc::pal {
+
+// Output file supporting positioned writes from several threads at once (pwrite on POSIX;
+// serialized seek+write elsewhere).
+class OutputFile {
+public:
+    OutputFile() = default;
+    ~OutputFile();
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    // Creates or truncates the file.
+    bool open(const std::filesystem::path& path);
+    // Writes all `size` bytes at `offset`. Safe to call concurrently for disjoint ranges.
+    bool writeAt(const void* data, size_t size, uint64_t offset);
+    bool close();
+
+    bool isOpen() const { return handle_ != nullptr; }
+
+private:
+    void* handle_ = nullptr; // FILE* (Windows) or fd+1 cast to pointer (POSIX)
+    std::mutex m_;
+};
+
+} // namespace rawproc::pal
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace rawproc::pal {
+
+// NUMA topology as seen by the OS. On Linux this is read from sysfs
+// (/sys/devices/system/node/node*/cpulist); elsewhere, or when sysfs is not
+// available, a single node containing all logical CPUs is reported.
+struct NumaTopology {
+    // CPU ids per node; index = compact node index (not necessarily the OS node id).
+    std::vector<std::vector<int>> nodeCpus;
+
+    size_t nodeCount() const { return nodeCpus.empty() ? 1 : nodeCpus.size(); }
+
+    static NumaTopology detect();
+};
+
+// Parses a Linux cpulist string such as "0-3,8-11,16".
+std::vector<int> parseCpuList(const char* s);
+
+// Pins the calling thread to the given CPU set. Returns false if unsupported or on failure.
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+} // namespace rawproc::pal
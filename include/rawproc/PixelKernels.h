@@ -0,0 +1,189 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace rawproc {
+
+enum class PixelFormat { U8, U16, F16, F32 };
+enum class PixelLayout { Interleaved, Planar };
+
+inline size_t pixelFormatSize(PixelFormat f) {
+    return f == PixelFormat::U8 ? 1 : f == PixelFormat::F32 ? 4 : 2;
+}
+
+// Round-to-nearest-even float -> IEEE half (NaN -> quiet NaN, overflow -> inf). Branch-free so
+// that F16 row stores vectorize: the float adder does the rounding. Scaling |f| by 2^112 * 2^-110
+// turns what overflows a half into inf; adding a power of two sized from f's exponent (no smaller
+// than for the least normal half) rounds the mantissa to the half's 10 bits, fewer for
+// subnormals, and the half is read back from the sum's bits. Needs the default rounding mode.
+inline uint16_t floatToHalf(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, 4);
+    float a;
+    const uint32_t abs = x & 0x7FFFFFFFu;
+    std::memcpy(&a, &abs, 4);
+    float base = (a * 0x1.0p+112f) * 0x1.0p-110f;
+    const uint32_t shl1 = x + x;
+    uint32_t bias = shl1 & 0xFF000000u;
+    bias = std::max(bias, 0x71000000u);
+    const uint32_t roundBits = (bias >> 1) + 0x07800000u;
+    float round;
+    std::memcpy(&round, &roundBits, 4);
+    base += round;
+    uint32_t bits;
+    std::memcpy(&bits, &base, 4);
+    const uint32_t h = ((bits >> 13) & 0x7C00u) + (bits & 0x0FFFu);
+    const uint32_t nan = 0u - static_cast<uint32_t>(shl1 > 0xFF000000u);
+    return static_cast<uint16_t>(((x >> 16) & 0x8000u) | (nan & 0x7E00u) | (~nan & h));
+}
+
+inline float halfToFloat(uint16_t h) {
+    const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+    uint32_t exp = (h >> 10) & 0x1Fu, mant = h & 0x3FFu;
+    uint32_t x;
+    if (exp == 0x1F) {
+        x = sign | 0x7F800000u | (mant << 13);
+    } else if (exp) {
+        x = sign | ((exp + 112u) << 23) | (mant << 13);
+    } else if (!mant) {
+        x = sign;
+    } else { // subnormal: renormalize
+        exp = 113;
+        while (!(mant & 0x400u)) { mant <<= 1; --exp; }
+        x = sign | (exp << 23) | ((mant & 0x3FFu) << 13);
+    }
+    float f;
+    std::memcpy(&f, &x, 4);
+    return f;
+}
+
+// Storage type and float conversion per format. Integer stores round to nearest and saturate
+// (NaN -> 0); they are written branch-free so that the row loops vectorize.
+template <PixelFormat F> struct PixelTraits;
+template <> struct PixelTraits<PixelFormat::U8> {
+    using type = uint8_t;
+    static float load(uint8_t v) { return static_cast<float>(v); }
+    static uint8_t store(float v) {
+        float q = v + 0.5f;
+        q = q > 0.0f ? q : 0.0f;
+        q = q < 255.0f ? q : 255.0f;
+        return static_cast<uint8_t>(q);
+    }
+};
+template <> struct PixelTraits<PixelFormat::U16> {
+    using type = uint16_t;
+    static float load(uint16_t v) { return static_cast<float>(v); }
+    static uint16_t store(float v) {
+        float q = v + 0.5f;
+        q = q > 0.0f ? q : 0.0f;
+        q = q < 65535.0f ? q : 65535.0f;
+        return static_cast<uint16_t>(q);
+    }
+};
+template <> struct PixelTraits<PixelFormat::F16> {
+    using type = uint16_t; // IEEE binary16 bits
+    static float load(uint16_t v) { return halfToFloat(v); }
+    static uint16_t store(float v) { return floatToHalf(v); }
+};
+template <> struct PixelTraits<PixelFormat::F32> {
+    using type = float;
+    static float load(float v) { return v; }
+    static float store(float v) { return v; }
+};
+
+// A rectangle of pixels in one of the supported formats. Interleaved: planes[0] holds all
+// channels and `stride` counts elements per row. Planar: planes[c] is channel c (so planes may be
+// listed in any order, e.g. B, G, R for EXR) and `stride` counts elements per plane row.
+// Sources are only read.
+struct PixelRect {
+    void* planes[4] = {nullptr, nullptr, nullptr, nullptr};
+    PixelFormat format = PixelFormat::F32;
+    PixelLayout layout = PixelLayout::Interleaved;
+    uint32_t channels = 1;
+    uint32_t width = 0, height = 0;
+    size_t stride = 0;
+
+    static PixelRect interleaved(const void* data, PixelFormat f, uint32_t channels,
+                                 uint32_t w, uint32_t h, size_t stride) {
+        PixelRect r;
+        r.planes[0] = const_cast<void*>(data);
+        r.format = f;
+        r.channels = channels;
+        r.width = w; r.height = h;
+        r.stride = stride;
+        return r;
+    }
+    static PixelRect planar(const void* const* planes, uint32_t channels, PixelFormat f,
+                            uint32_t w, uint32_t h, size_t stride) {
+        PixelRect r = interleaved(nullptr, f, channels, w, h, stride);
+        r.layout = PixelLayout::Planar;
+        for (uint32_t c = 0; c < channels && c < 4; ++c) r.planes[c] = const_cast<void*>(planes[c]);
+        return r;
+    }
+};
+
+// Element-wise dst = clamp((src + bias) * scale, lo, hi); the default is a plain format change.
+// The clamp passes NaN through (integer stores then map it to 0).
+struct ConvertParams {
+    float bias = 0.0f;
+    float scale = 1.0f;
+    float lo = -std::numeric_limits<float>::infinity();
+    float hi = std::numeric_limits<float>::infinity();
+    float alpha = 1.0f;  // 3 -> 4 channels: value of the added channel, in destination units
+    bool swapRB = false; // 3 -> 4 channels: BGRA instead of RGBA
+};
+
+namespace kernels {
+
+// One fully specialized conversion: formats, channel counts and layouts are compile-time, so the
+// inner loop has constant element steps and no per-pixel dispatch. SC == 1 with DC > 1 replicates
+// the single source channel (gray -> RGB); SC == 3 with DC == 4 appends p.alpha, with R and B
+// exchanged when Swap is set. Converts dst.width x dst.height pixels.
+template <PixelFormat SF, PixelFormat DF, uint32_t SC, uint32_t DC, PixelLayout SL, PixelLayout DL, bool Swap = false>
+void convertRect(const PixelRect& src, const PixelRect& dst, const ConvertParams& p) {
+    static_assert(SC == DC || SC == 1 || (SC == 3 && DC == 4), "unsupported channel mapping");
+    using S = PixelTraits<SF>;
+    using D = PixelTraits<DF>;
+    using ST = typename S::type;
+    using DT = typename D::type;
+    constexpr size_t sStep = SL == PixelLayout::Interleaved ? SC : 1;
+    constexpr size_t dStep = DL == PixelLayout::Interleaved ? DC : 1;
+    const float bias = p.bias, scale = p.scale, lo = p.lo, hi = p.hi;
+    const DT alpha = D::store(p.alpha);
+    for (uint32_t y = 0; y < dst.height; ++y) {
+        const ST* s[SC];
+        DT* d[DC];
+        for (uint32_t c = 0; c < SC; ++c) {
+            s[c] = SL == PixelLayout::Interleaved
+                ? static_cast<const ST*>(src.planes[0]) + y * src.stride + c
+                : static_cast<const ST*>(src.planes[c]) + y * src.stride;
+        }
+        for (uint32_t c = 0; c < DC; ++c) {
+            d[c] = DL == PixelLayout::Interleaved
+                ? static_cast<DT*>(dst.planes[0]) + y * dst.stride + c
+                : static_cast<DT*>(dst.planes[c]) + y * dst.stride;
+        }
+        for (uint32_t x = 0; x < dst.width; ++x) {
+            for (uint32_t c = 0; c < DC; ++c) {
+                if (SC == 3 && c == 3) { d[c][x * dStep] = alpha; continue; }
+                const uint32_t sc = SC == 1 ? 0 : Swap ? 2 - c : c;
+                const float v = (S::load(s[sc][x * sStep]) + bias) * scale;
+                d[c][x * dStep] = D::store(std::min(std::max(v, lo), hi));
+            }
+        }
+    }
+}
+
+} // namespace kernels
+
+// Converts `src` into `dst` (dst.width x dst.height pixels; src must be at least that large),
+// dispatching once to the matching kernels::convertRect instance. Supported channel setups are
+// 1 -> 1, 1 -> 3 and 3 -> 3 in any format and layout pair, and 3 -> 4 (RGBA / BGRA) into
+// interleaved destinations; a plain copy between identical formats is done with row memcpy.
+// Returns false for unsupported combinations.
+bool convertPixels(const PixelRect& src, const PixelRect& dst, const ConvertParams& p = {});
+
+} // namespace rawproc
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+#include "rawproc/TaskScheduler.h"
+
+namespace rawproc {
+
+// PNG row filter selection. Adaptive picks, per row, the filter with the smallest sum of
+// absolute (signed) residuals, the same heuristic libpng uses.
+enum class PngFilter { None = 0, Sub = 1, Up = 2, Average = 3, Paeth = 4, Adaptive = 5 };
+
+struct PngOptions {
+    int compression = 6;                    // zlib level 0..9
+    PngFilter filter = PngFilter::Adaptive;
+    bool parallel = true;                   // band-parallel deflate (requires zlib); else stb
+    uint32_t bandRows = 0;                  // rows per independently deflated band; 0 = auto
+};
+
+// Band-parallel PNG writer (pigz style): each row band is produced, filtered and deflated
+// concurrently as a raw deflate stream ending in a sync flush (the last one finishes), primed with
+// the preceding 32 KiB of filtered data as dictionary so compression barely suffers. The streams are
+// stitched behind one zlib header with a combined Adler-32 into a valid IDAT sequence.
+// `rows(y0, y1, dst)` fills rows [y0, y1) of interleaved samples (`channels` 1..4, `bitDepth` 8 or
+// 16, 16-bit samples big-endian as PNG stores them) into a tightly packed buffer; it is called
+// concurrently for different bands. Bands are encoded and written in waves, so no full-frame
+// output buffer is ever held. Returns false if zlib support is not compiled in or on I/O errors.
+bool writePngParallel(const std::filesystem::path& path, uint32_t width, uint32_t height,
+                      uint32_t channels, int bitDepth,
+                      const std::function<void(uint32_t, uint32_t, uint8_t*)>& rows,
+                      const PngOptions& opt, ITaskScheduler* sched);
+
+// Same for an interleaved 8-bit buffer with tightly packed rows.
+bool writePngParallel(const std::filesystem::path& path, const uint8_t* pixels,
+                      uint32_t width, uint32_t height, uint32_t channels,
+                      const PngOptions& opt, ITaskScheduler* sched);
+
+} // namespace rawproc
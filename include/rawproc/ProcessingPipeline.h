@@ -1,48 +1,118 @@
 #pragma once
 #include <vector>
 
+#include "rawproc/ExecutionPlan.h"
 #include "rawproc/IProcessingPlugin.h"
 #include "rawproc/PluginManager.h"
 #include "rawproc/UnifiedRawData.h"
 #include "rawproc/Tiling.h"
 #include "rawproc/ThreadPool.h"
 #include "rawproc/GpuContext.h"
+#include "rawproc/TileTuner.h"
+#include <atomic>
+#include <functional>
 #include <list>
+#include <memory>
 #include <mutex>
 
 namespace rawproc {
 
-enum class RenderMode { GrayscalePreview, FullColor };
-
+// All apply*() calls may run concurrently on one pipeline (e.g. a thumbnail and a viewport of
+// the same image); they share the worker pool, the tile and analysis caches and the mip pyramid.
+// Plugin instances must not be created or destroyed while renders are running.
 class ProcessingPipeline {
 public:
-    explicit ProcessingPipeline(PluginManager& pm) : pm_(pm) {}
+    explicit ProcessingPipeline(PluginManager& pm) : pm_(pm), pool_(std::make_unique<ThreadPool>()) {}
 
     // Applies the pipeline and returns a simple RGB image for preview/export.
     RgbImageF apply(const UnifiedRawData& data, RenderMode mode = RenderMode::GrayscalePreview);
     RgbImageF apply(const UnifiedRawData& data, const RenderRequest& request, RenderMode mode = RenderMode::GrayscalePreview);
+    // Same render, but returns the tile buffers (shared with the tile cache) instead of an
+    // assembled frame; exporters can consume them directly.
+    RgbTileSet applyTiles(const UnifiedRawData& data, const RenderRequest& request, RenderMode mode = RenderMode::GrayscalePreview);
+    // Partial renders without a full-frame buffer: the image covers only the bounding box of the
+    // requested tiles (clipped to the frame), whose frame position is returned in origin.
+    RgbImageF applyViewport(const UnifiedRawData& data, const RenderRequest& request, RenderMode mode,
+                            int& originX, int& originY);
+    // Writes the requested tiles into a caller-owned buffer (see RenderTarget), converting each
+    // tile to the target format as it is blitted; pixels no tile covers are left untouched.
+    void applyInto(const UnifiedRawData& data, const RenderRequest& request, const RenderTarget& target,
+                   RenderMode mode = RenderMode::GrayscalePreview);
+    // The frame-shaped outputs above show the tiles at request.lod; tiles at other LODs are still
+    // rendered (and cached), e.g. to warm the next zoom level. This returns every requested tile,
+    // each in its own LOD's pixel space, ordered by LOD then row-major.
+    std::vector<RgbTile> applyTileList(const UnifiedRawData& data, const RenderRequest& request,
+                                       RenderMode mode = RenderMode::GrayscalePreview);
+
+    // LOD geometry. Each level halves the previous one and the chain ends at the first level
+    // that is 1 pixel thin; returns the LOD actually rendered for `lod` (clamped to the chain)
+    // and its frame size.
+    static int lodFrameSize(uint32_t baseWidth, uint32_t baseHeight, int lod, uint32_t& width, uint32_t& height);
+    // Tiles of the tileSize grid at `lod` covering the LOD-0 viewport (x, y, width, height),
+    // clipped to the frame.
+    static std::vector<TileCoord> tilesForViewport(uint32_t baseWidth, uint32_t baseHeight, int x, int y,
+                                                   int width, int height, int lod, int tileSize);
+
+    // Tile size a request renders with: request.tileSize, or the tuner's choice for this plugin
+    // chain, mode and LOD when it is 0. Callers building tile lists for such requests use this.
+    int resolveTileSize(const UnifiedRawData& data, const RenderRequest& request, RenderMode mode = RenderMode::GrayscalePreview);
+    // Times full-frame renders of `data` at `lod` with tile sizes around the model's choice on a
+    // scratch pipeline (same plugins, empty caches) and records the fastest in tileTuner().
+    int calibrateTileSize(const UnifiedRawData& data, RenderMode mode = RenderMode::GrayscalePreview, int lod = 1);
+    TileTuner& tileTuner() { return tuner_; }
+    // What the tuner is asked for this chain, mode and LOD (apron, bytes per pixel, workers, frame).
+    TileTuner::Inputs tileInputs(const UnifiedRawData& data, int lod, RenderMode mode) const;
+
+    // The compiled chain renders of data.history in `mode` use: the last plan for the mode while
+    // the history and the plugins' parameter states are unchanged, else a fresh one.
+    std::shared_ptr<const ExecutionPlan> executionPlan(const UnifiedRawData& data, RenderMode mode) const;
 
     // Clear any internal tile caches (call when parameters/history/source change significantly).
     void clearCache();
+    // Local edits made outside the plugins' own reporting (see IProcessingPlugin::takeDirtyRegion):
+    // drops the cached tiles of `data` that depend on the LOD-0 rectangle `region`, including
+    // the apron of the whole chain, at every LOD and in both modes.
+    void invalidateRegion(const UnifiedRawData& data, const PixelRegion& region);
     void setCacheCapacityMB(size_t mb) { setCacheCapacityBytes(mb * 1024ull * 1024ull); }
+    // Budget for the RAW mip pyramids of recently rendered sources, so flipping between images
+    // does not rebuild them; the least recently used pyramids are dropped first.
+    void setMipCacheCapacityMB(size_t mb);
 
     // Toggle GPU path (if available); currently falls back to CPU when unavailable.
     void setUseGpu(bool on) { useGpu_ = on; }
     void setGpuDebugMode(int mode);
     void setGpuSynthetic(bool on);
 
+    // The worker pool renders run on; exporters can share it (ImageExporter::setScheduler).
+    // Replaced by setNumaAware().
+    ITaskScheduler& scheduler() { return *pool_; }
+
+    // NUMA-aware scheduling: workers are pinned per node, tile bands run on the node owning
+    // their output rows and output buffers are first-touched by that node. Recreates the
+    // worker pool; must not be called while apply() is running.
+    void setNumaAware(bool on);
+
 private:
     PluginManager& pm_;
     // Simple thread pool for parallel tile processing
-    ThreadPool pool_;
+    std::unique_ptr<ThreadPool> pool_;
+    bool numaAware_ = false;
+    TileTuner tuner_;
 
     // Very simple tile cache keyed by a combined hash.
     struct CachedTile {
         int w = 0, h = 0;
-        std::shared_ptr<std::vector<float>> data; // interleaved RGB
+        std::shared_ptr<PixelBuffer<float>> data; // interleaved RGB
+    };
+    // Where a cached tile comes from: the image (PipelineHashes::source) and its inner rect
+    // (tile size) on its LOD's grid.
+    struct TileTag {
+        size_t source = 0;
+        int lod = 0, x = 0, y = 0;
     };
     struct CacheEntry {
         CachedTile tile;
+        TileTag tag;
         size_t bytes = 0;
         std::list<size_t>::iterator lruIt; // points into lru_ list
     };
@@ -52,30 +122,101 @@ private:
     size_t cacheBytes_ = 0;
     std::mutex cacheMutex_;
 
-    // Simple RAW mip cache for LOD (grayscale preview only)
-    std::vector<RawImage> rawMips_;
-    uint32_t mipsBaseW_ = 0, mipsBaseH_ = 0;
+    // Global analysis results of two-phase plugins, keyed by source + params prefix + analysis LOD.
+    using Analyses = std::vector<std::shared_ptr<const AnalysisResult>>; // indexed like data.history
+    std::unordered_map<size_t, std::shared_ptr<const AnalysisResult>> analysisCache_;
+    std::mutex analysisMutex_;
+
+    // RAW mip pyramid of one source for LOD; mosaic-preserving (cfa) for full color, box-averaged
+    // otherwise. levels[i] is LOD i + 1 (LOD 0 is the source itself). A published chain is never
+    // modified: it is replaced by an extended copy that shares the existing levels, and each
+    // render keeps the chain it started with alive.
+    struct MipChain {
+        uint64_t source = 0; // content hash of the source
+        uint32_t baseW = 0, baseH = 0;
+        bool cfa = false;
+        std::vector<std::shared_ptr<const RawImage>> levels;
+        size_t bytes = 0;
+
+        const RawImage& level(const RawImage& source, int lod) const { return lod > 0 ? *levels[lod - 1] : source; }
+    };
+    // Pyramids of several sources, most recently used first, within mipCapacityBytes_.
+    std::list<std::shared_ptr<const MipChain>> mipCache_;
+    size_t mipCapacityBytes_ = 256ull * 1024ull * 1024ull;
+    size_t mipBytes_ = 0;
+    std::mutex mipsMutex_; // held while levels are built, so concurrent renders share one build
+    void mipEvictIfNeeded();
+
+    // Frame size, bounding box [x0, x1) x [y0, y1) of the requested tiles, and whether the tiles
+    // fill that box / the whole frame (so outputs need no clearing).
+    struct FrameInfo {
+        int lod = 0;
+        uint32_t width = 0, height = 0;
+        int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+        bool tilesCovered = false;
+        bool frameCovered = false;
+    };
+    static FrameInfo frameInfo(const RenderRequest& req, uint32_t w, uint32_t h);
+
+    // Shared render core: onFrame is called once before any tile, onTile from worker threads. A
+    // request whose tiles are all cached is answered from the cache without touching the raw data.
+    void renderTiles(const UnifiedRawData& data, const RenderRequest& request, RenderMode mode,
+                     const std::function<void(const FrameInfo&)>& onFrame,
+                     const std::function<void(const RgbTile&)>& onTile);
+    // apply()/applyViewport(): frame-sized, or cropped to the tiles' bounding box.
+    RgbImageF render(const UnifiedRawData& data, const RenderRequest& request, RenderMode mode,
+                     bool cropToTiles, int& originX, int& originY);
 
     size_t computePipelineHash(const UnifiedRawData& data, RenderMode mode, int tileSize, int lod);
     static size_t hashCombine(size_t a, size_t b);
-    void ensureRawMips(const UnifiedRawData& data, int lodNeeded);
-    static RawImage downsample2x(const RawImage& in);
+    // Returns the mip chain of `data` (content hash `source`) down to lodNeeded, or to its
+    // 1-pixel end, building missing levels.
+    std::shared_ptr<const MipChain> acquireMips(const UnifiedRawData& data, uint64_t source, int lodNeeded, bool cfa);
+    RawImage downsample2x(const RawImage& in, bool cfa);
+    // Runs fn(y0, y1) over row bands of an image in parallel, each band on the NUMA node owning it.
+    void parallelRows(uint32_t height, const std::function<void(uint32_t, uint32_t)>& fn);
 
     // cache helpers
-    std::shared_ptr<std::vector<float>> cacheLookup(size_t key, int w, int h);
-    void cacheInsert(size_t key, int w, int h, std::shared_ptr<std::vector<float>> data);
+    std::shared_ptr<PixelBuffer<float>> cacheLookup(size_t key, int w, int h);
+    // All-or-nothing lookup under one lock: fills tiles[i].data and refreshes the LRU only if
+    // every key hits with the expected tile size.
+    bool cacheLookupAll(const std::vector<size_t>& keys, std::vector<RgbTile>& tiles);
+    static size_t tileKey(size_t pipelineHash, const TileCoord& tc) {
+        return hashCombine(pipelineHash, static_cast<size_t>((tc.lod << 28) ^ (tc.y << 14) ^ tc.x));
+    }
+    void cacheInsert(size_t key, const TileTag& tag, int w, int h, std::shared_ptr<PixelBuffer<float>> data);
     void cacheEvictIfNeeded();
+    void cacheErase(std::unordered_map<size_t, CacheEntry>::iterator it);
+    // Drops the tiles of `source` whose inner rect, grown by `apron` level pixels, reads the
+    // LOD-0 rectangle `region` at any LOD.
+    void invalidateTiles(size_t source, const PixelRegion& region, int apron);
     void setCacheCapacityBytes(size_t bytes) { std::lock_guard<std::mutex> lk(cacheMutex_); cacheCapacityBytes_ = bytes; cacheEvictIfNeeded(); }
 
-    struct PipelineHashes { size_t source=0, params=0, geom=0; };
-    PipelineHashes computeHashes(const UnifiedRawData& data, RenderMode mode, int tileSize, int lod);
+    struct PipelineHashes {
+        size_t source=0, params=0, geom=0;
+        uint64_t content=0; // data.sourceHash, or hashRawContent(data.raw) when it is unset
+    };
+    PipelineHashes computeHashes(const UnifiedRawData& data, const ExecutionPlan& plan, int tileSize);
     static size_t combineHashes(const PipelineHashes& h) {
         return hashCombine(hashCombine(h.source, h.params), h.geom);
     }
 
-    // GPU (stub/fallback for now)
+    // Two-phase plugins: fill `out` from the analysis cache and record each analyzer's key.
+    // Returns the LOD to analyze at if any result is missing, else -1.
+    int lookupAnalyses(const ExecutionPlan& plan, const PipelineHashes& h, Analyses& out, std::vector<size_t>& keys);
+    // Runs the chain on the whole mip at `lod` and computes the missing analyses.
+    void runGlobalAnalysis(const UnifiedRawData& data, const ExecutionPlan& plan, const MipChain& mips, int lod, float blackN,
+                           float invNorm, const std::vector<size_t>& keys, Analyses& out);
+
+    // Last compiled plan per RenderMode.
+    mutable std::shared_ptr<const ExecutionPlan> plans_[2];
+    mutable std::mutex planMutex_;
+
+    // GPU (stub/fallback for now); one context, created on first use. gpuMutex_ guards its
+    // creation and settings and serializes its use across concurrent renders.
     std::unique_ptr<GpuContext> gpu_;
-    bool useGpu_ = false;
+    std::mutex gpuMutex_;
+    std::atomic<bool> useGpu_{false};
     int gpuDebugMode_ = 0; // 0=real,1=coords,2=raw
     bool gpuSynth_ = false;
 };
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "rawproc/ImageTypes.h"
+#include "rawproc/TaskScheduler.h"
+
+namespace rawproc {
+
+struct QuantizeOptions {
+    // Ordered (8x8 Bayer) dithering; breaks up banding in smooth gradients at 8 bits.
+    bool dither = false;
+};
+
+// Converts `height` rows of `width` pixels (`channels` interleaved floats, nominally [0,1]) to
+// 8-bit with rounding and clamping (NaN maps to 0). Strides are in elements. originX/originY are
+// the block's position in the final frame and keep the dither pattern continuous across tiles.
+// Uses SSE2 when available.
+void quantizeRowsU8(const float* src, size_t srcStride, uint8_t* dst, size_t dstStride,
+                    uint32_t width, uint32_t height, uint32_t channels,
+                    int originX, int originY, const QuantizeOptions& opt);
+
+// 16-bit counterpart (no dithering needed): rounds v * 65535 and clamps. With bigEndian the
+// samples are stored most significant byte first, as PNM/PNG expect.
+void quantizeRowsU16(const float* src, size_t srcStride, uint16_t* dst, size_t dstStride,
+                     uint32_t width, uint32_t height, uint32_t channels, bool bigEndian);
+
+// Whole-frame helpers returning interleaved 8-bit RGB. Work is split over row bands (or tiles)
+// on `sched` when given.
+PixelBuffer<uint8_t> quantizeU8(const RgbImageF& img, const QuantizeOptions& opt, ITaskScheduler* sched);
+PixelBuffer<uint8_t> quantizeU8(const RgbTileSet& tiles, const QuantizeOptions& opt, ITaskScheduler* sched);
+
+} // namespace rawproc
@@ -1,14 +1,78 @@
 #pragma once
+#include <cstddef>
 #include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
 #include <optional>
+#include <vector>
 
+#include "rawproc/TaskScheduler.h"
 #include "rawproc/UnifiedRawData.h"
 
 namespace rawproc {
 
+struct ThumbnailOptions {
+    uint32_t maxSize = 256;     // longest edge wanted; bitmaps are box-downscaled to fit (0 = as is)
+    bool allowEmbedded = true;  // use the camera's embedded preview (no raw decode)
+    bool allowHalfSize = true;  // else fall back to a half-size raw decode (no demosaic)
+};
+
+// Catalog preview. Embedded JPEG previews are returned still encoded (they can be shown or
+// written as-is); bitmap previews and half-size decodes come back as 8-bit interleaved RGB.
+struct Thumbnail {
+    enum class Kind { Jpeg, Bitmap };
+    Kind kind = Kind::Bitmap;
+    std::vector<uint8_t> jpeg;   // Kind::Jpeg: encoded bytes
+    PixelBuffer<uint8_t> rgb;    // Kind::Bitmap: width*height*3
+    uint32_t width = 0;          // pixel size (as reported by the file for JPEG)
+    uint32_t height = 0;
+    int flip = 0;                // LibRaw orientation code: 0 none, 3 180°, 5 90° CCW, 6 90° CW
+};
+
 class RawLoader {
 public:
+    RawLoader();
+    ~RawLoader();
+
+    // Decodes on the calling thread, or takes over a prefetch of the same path if one exists.
     std::optional<UnifiedRawData> load(const std::filesystem::path& path);
+
+    // Decodes on the loader's own I/O + decode pool (created on first use, see setDecodeThreads),
+    // several files at once, each with its own LibRaw instance (hence the thread-safe raw_r build).
+    // Every background decode first reserves its peak footprint against the memory budget and
+    // waits while that is exhausted; a single decode larger than the budget still runs alone.
+    std::future<std::optional<UnifiedRawData>> loadAsync(const std::filesystem::path& path);
+    // Decodes `path` ahead of time so that a later load()/loadAsync() of it returns at once, e.g.
+    // the next file of a sequence while the current one is being edited. Unclaimed results keep
+    // their reservation; the oldest finished ones are dropped when another decode needs the room.
+    void prefetch(const std::filesystem::path& path);
+    // Drops prefetched results that have not been claimed; queued prefetches are skipped, decodes
+    // in progress still finish and then free their image.
+    void clearPrefetched();
+
+    void setDecodeThreads(size_t n) { decodeThreads_ = n; } // before the first background decode
+    void setMemoryBudget(size_t bytes);                      // default 1 GiB
+
+    // Fast preview without unpacking the sensor data: the embedded camera preview closest to
+    // (but not below) opt.maxSize if there is one, otherwise a half-size decode.
+    std::optional<Thumbnail> loadThumbnail(const std::filesystem::path& path, const ThumbnailOptions& opt = {});
+    // Same for many files at once; each task uses its own decoder instance. Results are in input order.
+    std::vector<std::optional<Thumbnail>> loadThumbnails(const std::vector<std::filesystem::path>& paths,
+                                                         ITaskScheduler& sched, const ThumbnailOptions& opt = {});
+
+private:
+    struct Background;
+
+    // Backend decode (LibRaw or placeholder). `reserve`, if set, is called with the estimated peak
+    // footprint once the image size is known and before the bulk data is unpacked.
+    static std::optional<UnifiedRawData> decode(const std::filesystem::path& path,
+                                                const std::function<void(size_t)>& reserve);
+    Background& background();
+
+    size_t decodeThreads_ = 0; // 0 = min(4, hardware threads)
+    size_t memoryBudget_ = size_t(1) << 30;
+    std::unique_ptr<Background> bg_;
 };
 
 } // namespace rawproc
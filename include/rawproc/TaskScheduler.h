@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+namespace rawproc {
+
+// Task-scheduling service the host exposes to plugins. Work submitted here runs on the
+// pipeline's worker pool instead of plugin-owned threads. The calling thread always takes part
+// in the work, so nested use from inside a tile never oversubscribes the machine: when every
+// worker is already busy with tiles, the loop simply runs inline.
+class ITaskScheduler {
+public:
+    virtual ~ITaskScheduler() = default;
+
+    // Number of threads that may run tasks concurrently (including the caller).
+    virtual size_t concurrency() const = 0;
+
+    // Invokes body(begin, end) over disjoint chunks covering [0, count), each at least `grain`
+    // items (except the last). Blocks until every chunk has completed; the first exception
+    // thrown by body is rethrown here.
+    virtual void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) = 0;
+};
+
+} // namespace rawproc
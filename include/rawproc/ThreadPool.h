@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <condition_variable>
 #include <functional>
 #include <future>
@@ -6,35 +7,70 @@
 #include <thread>
 #include <vector>
 
+#include "rawproc/PAL/Numa.h"
+#include "rawproc/TaskScheduler.h"
+
 namespace rawproc {
 
-class ThreadPool {
+class ThreadPool final : public ITaskScheduler {
 public:
-    explicit ThreadPool(size_t n = std::thread::hardware_concurrency());
-    ~ThreadPool();
+    // numaAware: detect the NUMA topology at startup, split workers evenly across nodes and pin
+    // each worker to its node's CPUs. Work submitted with enqueueOnNode() is then preferentially
+    // run by workers of that node (idle workers still steal to keep the pool busy).
+    explicit ThreadPool(size_t n = std::thread::hardware_concurrency(), bool numaAware = false);
+    ~ThreadPool() override;
 
     template <class F>
     auto enqueue(F&& f) -> std::future<decltype(f())> {
+        return push(sharedQueue(), std::forward<F>(f));
+    }
+
+    // Enqueue with affinity to a NUMA node (node index is taken modulo nodeCount()).
+    template <class F>
+    auto enqueueOnNode(size_t node, F&& f) -> std::future<decltype(f())> {
+        return push(node % nodeCount_, std::forward<F>(f));
+    }
+
+    // ITaskScheduler: fork-join loop in which the caller participates. The caller works through
+    // the chunks no worker has taken yet and then sleeps until the taken ones finish; it never
+    // runs unrelated queued tasks, so calling this from inside a pool task (nested parallelism)
+    // neither deadlocks nor nests other work or spawns extra threads.
+    size_t concurrency() const override { return threads_.size() + 1; }
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) override;
+
+    size_t size() const { return threads_.size(); }
+    size_t nodeCount() const { return nodeCount_; }
+    // Node owning row y of an image with the given height (contiguous bands, one per node).
+    size_t nodeForRow(size_t y, size_t height) const {
+        return (nodeCount_ <= 1 || height == 0) ? 0 : std::min(nodeCount_ - 1, y * nodeCount_ / height);
+    }
+
+private:
+    template <class F>
+    auto push(size_t queue, F&& f) -> std::future<decltype(f())> {
         using R = decltype(f());
         auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
         std::future<R> fut = task->get_future();
         {
             std::unique_lock<std::mutex> lk(m_);
-            q_.emplace([task]{ (*task)(); });
+            queues_[queue].emplace([task]{ (*task)(); });
         }
         cv_.notify_one();
         return fut;
     }
 
-private:
-    void worker();
+    size_t sharedQueue() const { return nodeCount_; }
+    bool popLocked(size_t node, std::function<void()>& job);
+    void worker(size_t node);
 
     std::mutex m_;
     std::condition_variable cv_;
-    std::queue<std::function<void()>> q_;
+    // One queue per NUMA node followed by the shared (no affinity) queue.
+    std::vector<std::queue<std::function<void()>>> queues_;
     std::vector<std::thread> threads_;
+    pal::NumaTopology topo_;
+    size_t nodeCount_ = 1;
     bool stop_ = false;
 };
 
 } // namespace rawproc
-
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+#include "rawproc/TaskScheduler.h"
+
+namespace rawproc {
+
+enum class TiffCompression { None, Deflate };
+
+struct TiffOptions {
+    TiffCompression compression = TiffCompression::Deflate; // Deflate needs zlib; else stored
+    int level = 6;                                          // zlib level 1..9
+    bool predictor = true;                                  // horizontal differencing before Deflate
+    uint32_t rowsPerStrip = 0;                              // 0 = auto (~256 KiB, 1 MiB if stored)
+};
+
+// Baseline little-endian TIFF writer (one IFD, chunky strips, gray or RGB, 8 or 16 bits).
+// `rows(y0, y1, dst)` fills rows [y0, y1) of interleaved samples (16-bit samples little-endian)
+// into a tightly packed buffer and is called concurrently for different strips. Stored strips go
+// to their final offsets with positioned writes as they are converted; Deflate strips are
+// compressed in parallel and appended in waves, so no full-frame output buffer is held. The IFD
+// follows the image data. Classic TIFF only: returns false past 4 GiB or on I/O errors.
+bool writeTiff(const std::filesystem::path& path, uint32_t width, uint32_t height,
+               uint32_t channels, int bitDepth,
+               const std::function<void(uint32_t, uint32_t, uint8_t*)>& rows,
+               const TiffOptions& opt, ITaskScheduler* sched);
+
+} // namespace rawproc
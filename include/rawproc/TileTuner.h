@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include "rawproc/PAL/CpuCache.h"
+
+namespace rawproc {
+
+// Picks RenderRequest::tileSize when the caller leaves it at 0. A tile task runs its stages one
+// after the other over the raw tile plus apron and its RGB output, so the model takes the
+// largest tile for which the buffers of one stage fit half of a core's L2 share and the buffers
+// of all stages half of its L3 share, grows it until the apron overlap stays below a quarter of
+// the work, and caps it so that the frame still splits into several tiles per worker. A short benchmark
+// (ProcessingPipeline::calibrateTileSize) can replace the model for a given chain shape, worker
+// count and frame size class; those results are tied to the machine and can be persisted, and
+// still go through the tiles-per-worker cap.
+class TileTuner {
+public:
+    struct Inputs {
+        int apron = 0;             // aggregate apron in pixels at the rendered LOD
+        size_t bytesPerPixel = 14; // working set per pixel across the stages of a tile task
+        // Widest single stage: the demosaic reads the 16-bit tile and writes float RGB.
+        size_t stageBytesPerPixel = 2 + 3 * sizeof(float);
+        size_t workers = 1;
+        uint32_t frameWidth = 0, frameHeight = 0; // 0 if unknown
+    };
+
+    static constexpr int kMinTile = 32;
+    static constexpr int kMaxTile = 1024;
+    static constexpr int kGranule = 16; // tile sizes are multiples of this
+
+    explicit TileTuner(const pal::CpuCacheInfo& caches = pal::CpuCacheInfo::detect()) : caches_(caches) {}
+
+    // The calibrated size for this chain shape if there is one, else modelTileSize().
+    int tileSize(const Inputs& in) const;
+    int modelTileSize(const Inputs& in) const;
+    // Clamps to [kMinTile, kMaxTile] and rounds down to a multiple of kGranule.
+    static int roundTileSize(int size);
+    // floor(log2(frame pixels)), 0 if the frame size is unknown: calibrations are shared by
+    // frames (and LODs) of the same order of size only.
+    static int frameSizeClass(const Inputs& in);
+
+    void setCalibrated(const Inputs& in, int tileSize);
+    bool hasCalibration(const Inputs& in) const;
+
+    // One "<machine> <apron> <bytesPerPixel> <workers> <sizeClass> <tileSize>" line per calibrated
+    // shape. load() takes the lines of this machine; save() rewrites them and keeps those of
+    // other machines.
+    bool load(const std::filesystem::path& path);
+    bool save(const std::filesystem::path& path) const;
+    // Cache hierarchy and core count the calibration is valid for.
+    std::string machineKey() const;
+
+    const pal::CpuCacheInfo& caches() const { return caches_; }
+
+private:
+    // (apron, bytesPerPixel, workers, frameSizeClass)
+    using Shape = std::tuple<int, size_t, size_t, int>;
+    static Shape shapeOf(const Inputs& in);
+    // Largest size that still gives four tiles per worker, kMaxTile if the frame is unknown.
+    static int loadBalanceCap(const Inputs& in);
+
+    pal::CpuCacheInfo caches_;
+    mutable std::mutex m_;
+    std::map<Shape, int> calibrated_; // -> tile size
+};
+
+} // namespace rawproc
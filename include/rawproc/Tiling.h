@@ -1,5 +1,6 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace rawproc {
@@ -21,14 +22,36 @@ struct TileSpec {
 };
 
 struct RenderRequest {
-    int tileSize = 256; // square tile size in pixels for inner region
-    int lod = 0;
-    // Full output size in pixels (at the selected LOD)
+    int tileSize = 256; // square tile size in pixels for inner region; 0 = tuned (TileTuner)
+    int lod = 0;        // LOD of the frame (and of the tiles generated when `tiles` is empty)
+    // Optional clip of the frame at `lod`; 0 or anything larger than the mip means the whole mip.
     int outWidth = 0;
     int outHeight = 0;
-    // If empty, the pipeline may compute a full-frame tile list. Otherwise, process only these tiles.
+    // If empty, the pipeline may compute a full-frame tile list. Otherwise, process only these
+    // tiles, each on the grid of its own TileCoord::lod.
     std::vector<TileCoord> tiles;
 };
 
+// Pixel formats a RenderTarget can receive. Integer formats map [0, 1] to the full range with
+// rounding; RGBA / BGRA get an opaque alpha.
+enum class TargetFormat {
+    RgbF32,
+    RgbU16,
+    RgbaU8,
+    BgraU8,
+};
+
+// Caller-owned destination, e.g. a mapped texture or window surface. Frame pixel (x, y) goes to
+// row (y - originY), column (x - originX); pixels outside width x height are dropped.
+struct RenderTarget {
+    void* data = nullptr;
+    size_t stride = 0; // bytes per row (>= width * pixel size)
+    TargetFormat format = TargetFormat::RgbF32;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int originX = 0;
+    int originY = 0;
+};
+
 } // namespace rawproc
 
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -11,18 +12,48 @@ struct ProcessingStep {
     size_t instanceId = 0; // references PluginManager instance
 };
 
+// Colors of a CFA site: 0 = R, 1 = G, 2 = B, 3 = second G (as LibRaw's COLOR()).
+enum CfaColor : uint8_t { CFA_R = 0, CFA_G = 1, CFA_B = 2, CFA_G2 = 3 };
+
 struct CameraMeta {
     float wb[3] = {1.0f, 1.0f, 1.0f};
     // Sensor black/white levels for normalization in previews
     float black_level = 0.0f;
     float white_level = 65535.0f;
-    // Add matrices, EXIF fields etc. later
+    // Per-site black on top of black_level, indexed like `cfa`
+    float cfa_black[2][2] = {{0.0f, 0.0f}, {0.0f, 0.0f}};
+    // 2x2 Bayer pattern [row & 1][col & 1] relative to the active-area origin (default RGGB).
+    // `bayer` is false for sensors without one (X-Trans, monochrome, linear DNG).
+    uint8_t cfa[2][2] = {{CFA_R, CFA_G}, {CFA_G2, CFA_B}};
+    bool bayer = true;
+    // White-balanced camera RGB to linear sRGB (D65) and to CIE XYZ
+    float cam_to_srgb[3][3] = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    float cam_to_xyz[3][3] = {{0.412453f, 0.357580f, 0.180423f},
+                              {0.212671f, 0.715160f, 0.072169f},
+                              {0.019334f, 0.119193f, 0.950227f}};
+    // DNG BaselineExposure in EV (0 for other formats)
+    float baseline_exposure = 0.0f;
 };
 
 struct UnifiedRawData {
     RawImage raw; // original sensor data
     CameraMeta meta;
     std::vector<ProcessingStep> history;
+    // hashRawContent(raw), set by the loaders. Required by ProcessingPipeline, which keys
+    // everything derived from the pixels (mips, tiles) on it: callers building or modifying
+    // `raw` themselves must set it again. Left at 0, every render hashes the whole frame again,
+    // cache hits included (the pipeline warns once).
+    uint64_t sourceHash = 0;
 };
 
+// 64-bit hash of the size and pixels of `raw` (never 0).
+uint64_t hashRawContent(const RawImage& raw);
+
+// Folds `b` into `a`: the 64-bit mix every pipeline key (tiles, analyses, execution plans) is
+// built with.
+inline size_t hashMix(size_t a, size_t b) {
+    a ^= b + 0x9e3779b97f4a7c15ULL + (a << 6) + (a >> 2);
+    return a;
+}
+
 } // namespace rawproc
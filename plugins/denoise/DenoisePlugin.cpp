@@ -32,28 +32,42 @@ public:
         return std::hash<int>()(static_cast<int>(strength_ * 1000.0f + 0.5f));
     }
 
-    void process_raw(RawImage& raw) override {
+    void process_raw(RawImage& raw) override { process_raw(raw, ProcessContext{}); }
+
+    void process_raw(RawImage& raw, const ProcessContext& ctx) override {
         if (raw.data.empty() || raw.width < 3 || raw.height < 3) return;
         // Very cheap box blur pass controlled by strength.
         const int w = static_cast<int>(raw.width);
         const int h = static_cast<int>(raw.height);
-        std::vector<uint16_t> out(raw.data.size());
         const int radius = strength_ <= 0.001f ? 0 : (strength_ < 0.5f ? 1 : 2);
         if (radius == 0) return;
-        for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x) {
-                int sum = 0; int cnt = 0;
-                for (int dy = -radius; dy <= radius; ++dy) {
-                    int yy = std::clamp(y + dy, 0, h - 1);
-                    for (int dx = -radius; dx <= radius; ++dx) {
-                        int xx = std::clamp(x + dx, 0, w - 1);
-                        sum += raw.data[yy * w + xx];
-                        cnt++;
+        // Only the region later stages read is filtered; the apron around it keeps its input.
+        const PixelRegion& r = ctx.region;
+        const bool whole = r.width <= 0 || r.height <= 0;
+        const int rx0 = whole ? 0 : std::max(0, r.x), rx1 = whole ? w : std::min(w, r.x + r.width);
+        const int ry0 = whole ? 0 : std::max(0, r.y), ry1 = whole ? h : std::min(h, r.y + r.height);
+        if (rx1 <= rx0 || ry1 <= ry0) return;
+        decltype(raw.data) out(raw.data);
+        auto rows = [&](size_t y0, size_t y1) {
+            for (int y = ry0 + static_cast<int>(y0); y < ry0 + static_cast<int>(y1); ++y) {
+                for (int x = rx0; x < rx1; ++x) {
+                    int sum = 0; int cnt = 0;
+                    for (int dy = -radius; dy <= radius; ++dy) {
+                        int yy = std::clamp(y + dy, 0, h - 1);
+                        for (int dx = -radius; dx <= radius; ++dx) {
+                            int xx = std::clamp(x + dx, 0, w - 1);
+                            sum += raw.data[yy * w + xx];
+                            cnt++;
+                        }
                     }
+                    out[y * w + x] = static_cast<uint16_t>(sum / cnt);
                 }
-                out[y * w + x] = static_cast<uint16_t>(sum / cnt);
             }
-        }
+        };
+        // Split rows across the host pool when given one (e.g. whole-image or large tiles).
+        const size_t n = static_cast<size_t>(ry1 - ry0);
+        if (ctx.scheduler) ctx.scheduler->parallelFor(n, 64, rows);
+        else rows(0, n);
         raw.data.swap(out);
     }
 
@@ -0,0 +1,175 @@
+#include "rawproc/ColorStage.h"
+#include "rawproc/PixelKernels.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define RAWPROC_COLOR_SSE2 1
+#endif
+
+namespace rawproc {
+
+namespace {
+
+inline int channelOf(uint8_t site) { return site == CFA_G2 ? 1 : site; }
+
+inline float clip01(float v) {
+    // Written so that NaN falls through to 0.
+    v = v > 0.0f ? v : 0.0f;
+    return v < 1.0f ? v : 1.0f;
+}
+
+// Interpolation recipe for one 2x2 site: its own channel, and for each other channel the 3x3
+// neighbours carrying it. For a Bayer mosaic this is exactly bilinear (2 or 4 neighbours).
+struct Site {
+    int ch = 0;
+    float black = 0.0f;
+    int n[3] = {0, 0, 0};
+    int dx[3][8] = {}, dy[3][8] = {};
+    float nb[3][8] = {};           // black of each neighbour
+    float blackSum[3] = {0, 0, 0}; // sum of nb over all neighbours
+};
+
+void buildSites(const CameraMeta& meta, float black, Site (&sites)[2][2]) {
+    for (int py = 0; py < 2; ++py) {
+        for (int px = 0; px < 2; ++px) {
+            Site& s = sites[py][px];
+            s.ch = channelOf(meta.cfa[py][px]);
+            s.black = black + meta.cfa_black[py][px];
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    if (dx == 0 && dy == 0) continue;
+                    const int ny = (py + dy + 2) & 1, nx = (px + dx + 2) & 1;
+                    const int c = channelOf(meta.cfa[ny][nx]);
+                    if (c == s.ch) continue;
+                    const int k = s.n[c]++;
+                    s.dx[c][k] = dx;
+                    s.dy[c][k] = dy;
+                    s.nb[c][k] = black + meta.cfa_black[ny][nx];
+                    s.blackSum[c] += s.nb[c][k];
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+LinearColorTransform LinearColorTransform::fromMeta(const CameraMeta& meta) {
+    const float green = meta.wb[1] > 0.0f ? meta.wb[1] : 1.0f;
+    const float gain = std::exp2(meta.baseline_exposure);
+    LinearColorTransform t;
+    for (int j = 0; j < 3; ++j) {
+        const float wb = meta.wb[j] > 0.0f ? meta.wb[j] / green : 1.0f;
+        for (int i = 0; i < 3; ++i) t.m[i][j] = meta.cam_to_srgb[i][j] * wb * gain;
+    }
+    return t;
+}
+
+void applyLinearColor(float* rgb, size_t pixels, const LinearColorTransform& t) {
+    size_t p = 0;
+#if defined(RAWPROC_COLOR_SSE2)
+    __m128 m[3][3];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j) m[i][j] = _mm_set1_ps(t.m[i][j]);
+    const __m128 lo = _mm_setzero_ps();
+    const __m128 hi = _mm_set1_ps(1.0f);
+    // Four pixels per step: deinterleave 12 floats into R, G, B lanes, transform, interleave back.
+    for (; p + 4 <= pixels; p += 4) {
+        float* px = rgb + p * 3;
+        const __m128 a = _mm_loadu_ps(px);     // r0 g0 b0 r1
+        const __m128 b = _mm_loadu_ps(px + 4); // g1 b1 r2 g2
+        const __m128 c = _mm_loadu_ps(px + 8); // b2 r3 g3 b3
+        const __m128 r = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 0)),
+                                        _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 1, 0));
+        const __m128 g = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+                                        _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 bl = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+                                         _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 o[3];
+        for (int i = 0; i < 3; ++i) {
+            __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[i][0], r), _mm_mul_ps(m[i][1], g)), _mm_mul_ps(m[i][2], bl));
+            // max(v, lo) returns lo for NaN
+            o[i] = _mm_min_ps(_mm_max_ps(v, lo), hi);
+        }
+        const __m128 oa = _mm_shuffle_ps(_mm_shuffle_ps(o[0], o[1], _MM_SHUFFLE(0, 0, 0, 0)),
+                                         _mm_shuffle_ps(o[2], o[0], _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 ob = _mm_shuffle_ps(_mm_shuffle_ps(o[1], o[2], _MM_SHUFFLE(1, 1, 1, 1)),
+                                         _mm_shuffle_ps(o[0], o[1], _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+        const __m128 oc = _mm_shuffle_ps(_mm_shuffle_ps(o[2], o[0], _MM_SHUFFLE(3, 3, 2, 2)),
+                                         _mm_shuffle_ps(o[1], o[2], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        _mm_storeu_ps(px, oa);
+        _mm_storeu_ps(px + 4, ob);
+        _mm_storeu_ps(px + 8, oc);
+    }
+#endif
+    for (; p < pixels; ++p) {
+        float* px = rgb + p * 3;
+        const float r = px[0], g = px[1], b = px[2];
+        for (int i = 0; i < 3; ++i) px[i] = clip01(t.m[i][0] * r + t.m[i][1] * g + t.m[i][2] * b);
+    }
+}
+
+void demosaicBilinear(const RawImage& raw, int phaseX, int phaseY, const CameraMeta& meta,
+                      float black, float invNorm, int x0, int y0, int w, int h, float* out) {
+    if (w <= 0 || h <= 0) return;
+    if (!meta.bayer) {
+        ConvertParams p;
+        p.bias = -black;
+        p.scale = invNorm;
+        convertPixels(PixelRect::interleaved(raw.row(static_cast<uint32_t>(y0)) + x0, PixelFormat::U16, 1, w, h, raw.rowStride()),
+                      PixelRect::interleaved(out, PixelFormat::F32, 3, w, h, static_cast<size_t>(w) * 3u), p);
+        return;
+    }
+
+    Site sites[2][2];
+    buildSites(meta, black, sites);
+    float scale[2][2][3]; // invNorm / neighbour count
+    for (int py = 0; py < 2; ++py)
+        for (int px = 0; px < 2; ++px)
+            for (int c = 0; c < 3; ++c) {
+                const int n = sites[py][px].n[c];
+                scale[py][px][c] = n ? invNorm / static_cast<float>(n) : 0.0f;
+            }
+
+    const int W = static_cast<int>(raw.width), H = static_cast<int>(raw.height);
+    for (int y = 0; y < h; ++y) {
+        const int ay = y0 + y;
+        const int py = (ay + phaseY) & 1;
+        const uint16_t* rows[3] = {ay > 0 ? raw.row(static_cast<uint32_t>(ay - 1)) : nullptr,
+                                   raw.row(static_cast<uint32_t>(ay)),
+                                   ay + 1 < H ? raw.row(static_cast<uint32_t>(ay + 1)) : nullptr};
+        const bool rowInner = rows[0] && rows[2];
+        float* dst = out + static_cast<size_t>(y) * w * 3u;
+        for (int x = 0; x < w; ++x, dst += 3) {
+            const int ax = x0 + x;
+            const int px = (ax + phaseX) & 1;
+            const Site& s = sites[py][px];
+            dst[s.ch] = (static_cast<float>(rows[1][ax]) - s.black) * invNorm;
+            const bool inner = rowInner && ax > 0 && ax + 1 < W;
+            for (int c = 0; c < 3; ++c) {
+                if (c == s.ch) continue;
+                float sum = 0.0f;
+                if (inner) {
+                    for (int k = 0; k < s.n[c]; ++k) sum += static_cast<float>(rows[s.dy[c][k] + 1][ax + s.dx[c][k]]);
+                    dst[c] = (sum - s.blackSum[c]) * scale[py][px][c];
+                    continue;
+                }
+                float blackSum = 0.0f;
+                int cnt = 0;
+                for (int k = 0; k < s.n[c]; ++k) {
+                    const uint16_t* r = rows[s.dy[c][k] + 1];
+                    const int nx = ax + s.dx[c][k];
+                    if (!r || nx < 0 || nx >= W) continue;
+                    sum += static_cast<float>(r[nx]);
+                    blackSum += s.nb[c][k];
+                    ++cnt;
+                }
+                dst[c] = cnt ? (sum - blackSum) * invNorm / static_cast<float>(cnt) : 0.0f;
+            }
+        }
+    }
+}
+
+} // namespace rawproc
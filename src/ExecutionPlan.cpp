@@ -0,0 +1,109 @@
+#include "rawproc/ExecutionPlan.h"
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+
+namespace rawproc {
+
+namespace {
+
+const char* stageName(ProcessingStage s) {
+    switch (s) {
+    case ProcessingStage::PRE_DEMOSAIC: return "pre_demosaic";
+    case ProcessingStage::DEMOSAIC: return "demosaic";
+    case ProcessingStage::POST_DEMOSAIC_LINEAR: return "post_demosaic_linear";
+    case ProcessingStage::FINALIZE: return "finalize";
+    }
+    return "?";
+}
+
+} // namespace
+
+size_t ExecutionPlan::stateKey(PluginManager& pm, const std::vector<ProcessingStep>& history, RenderMode mode) {
+    std::hash<size_t> Hs;
+    size_t key = hashMix(Hs(static_cast<size_t>(mode)), Hs(history.size()));
+    for (const auto& step : history) {
+        auto inst = pm.getInstance(step.instanceId);
+        key = hashMix(key, Hs(step.instanceId));
+        key = hashMix(key, inst ? Hs(inst->stateHash()) : Hs(~size_t(0)));
+    }
+    return key;
+}
+
+std::shared_ptr<const ExecutionPlan> ExecutionPlan::build(PluginManager& pm, const std::vector<ProcessingStep>& history,
+                                                          RenderMode mode) {
+    std::hash<int> Hi; std::hash<std::string_view> Hsv; std::hash<size_t> Hs;
+    auto plan = std::make_shared<ExecutionPlan>();
+    plan->mode = mode;
+    plan->key = stateKey(pm, history, mode);
+    plan->historySize = history.size();
+    size_t rawSteps = 0;
+    for (size_t i = 0; i < history.size(); ++i) {
+        auto inst = pm.getInstance(history[i].instanceId);
+        if (!inst) continue;
+        Step s;
+        s.index = i;
+        s.instanceId = history[i].instanceId;
+        s.plugin = inst;
+        s.name = std::string(inst->getName());
+        s.stage = inst->getProcessingStage();
+        // Plugins are not required to shrink their kernel at coarser LODs, so the full radius
+        // is kept there too.
+        s.radius = static_cast<int>(inst->kernelRadiusPx());
+        s.writesRaw = inst->writesRaw();
+        if (inst->wantsGlobalAnalysis()) s.analysisLod = std::max(0, inst->analysisLod());
+        s.stateHash = inst->stateHash();
+        plan->paramsHash = hashMix(plan->paramsHash, Hsv(s.name));
+        plan->paramsHash = hashMix(plan->paramsHash, Hi(static_cast<int>(s.stage)));
+        plan->paramsHash = hashMix(plan->paramsHash, Hs(s.stateHash));
+        s.prefixHash = plan->paramsHash;
+        plan->analysisLod = std::max(plan->analysisLod, s.analysisLod);
+        if (s.stage == ProcessingStage::PRE_DEMOSAIC) ++rawSteps;
+        plan->steps.push_back(std::move(s));
+    }
+
+    const bool fullColor = mode == RenderMode::FullColor;
+    for (size_t i = 0; i < plan->steps.size(); ++i) {
+        const ProcessingStage st = plan->steps[i].stage;
+        if (st == ProcessingStage::POST_DEMOSAIC_LINEAR && !fullColor) continue;
+        plan->stages[static_cast<int>(st)].push_back(i);
+    }
+    // Margins accumulate backwards through the execution order.
+    int margin = 0;
+    auto walk = [&](ProcessingStage st) {
+        const auto& idx = plan->stage(st);
+        for (auto it = idx.rbegin(); it != idx.rend(); ++it) {
+            Step& s = plan->steps[*it];
+            s.margin = margin;
+            margin += s.radius;
+        }
+    };
+    walk(ProcessingStage::FINALIZE);
+    walk(ProcessingStage::POST_DEMOSAIC_LINEAR);
+    plan->rgbApron = margin;
+    // The bilinear demosaic reads one neighbour around each output pixel.
+    if (fullColor) ++margin;
+    walk(ProcessingStage::PRE_DEMOSAIC);
+    plan->rawApron = margin;
+    plan->bytesPerPixel = 2 * (1 + rawSteps) + 3 * sizeof(float);
+    return plan;
+}
+
+std::string ExecutionPlan::describe() const {
+    std::ostringstream os;
+    os << "plan mode=" << (mode == RenderMode::FullColor ? "color" : "gray") << " steps=" << steps.size() << "/" << historySize
+       << " raw_apron=" << rawApron << " rgb_apron=" << rgbApron << " bpp=" << bytesPerPixel
+       << " analysis_lod=" << analysisLod << " params=" << std::hex << paramsHash << std::dec << "\n";
+    for (ProcessingStage st : {ProcessingStage::PRE_DEMOSAIC, ProcessingStage::POST_DEMOSAIC_LINEAR, ProcessingStage::FINALIZE}) {
+        for (size_t i : stage(st)) {
+            const Step& s = steps[i];
+            os << s.index << " " << stageName(s.stage) << " " << s.name << " radius=" << s.radius << " margin=" << s.margin
+               << " writes_raw=" << (s.writesRaw ? 1 : 0) << " analysis_lod=" << s.analysisLod
+               << " state=" << std::hex << s.stateHash << std::dec << "\n";
+        }
+    }
+    return os.str();
+}
+
+} // namespace rawproc
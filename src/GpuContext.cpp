@@ -2,6 +2,7 @@
 
 #if !defined(RAWPROC_USE_WGPU_NATIVE)
 namespace rawproc {
+struct GpuContext::Impl {};
 GpuContext::GpuContext() {}
 GpuContext::~GpuContext() {}
 bool GpuContext::isAvailable() const { return false; }
@@ -285,10 +285,13 @@ bool GpuContext::processGrayAndGamma(const RawImage& tileRaw,
     } else {
         // Copy u16 -> u32 explicitly
         uint16_t tmin = 0xFFFF, tmax = 0;
-        for (size_t i = 0; i < inCount; ++i) {
-            uint16_t v = tileRaw.data[i];
-            if (v < tmin) tmin = v; if (v > tmax) tmax = v;
-            inData[i] = static_cast<uint32_t>(v);
+        for (int y = 0; y < sh; ++y) {
+            const uint16_t* src = tileRaw.row(static_cast<uint32_t>(y));
+            for (int x = 0; x < sw; ++x) {
+                uint16_t v = src[x];
+                if (v < tmin) tmin = v; if (v > tmax) tmax = v;
+                inData[static_cast<size_t>(y) * sw + x] = static_cast<uint32_t>(v);
+            }
         }
         if (dbgPrints < 4) {
             std::cerr << "GPU DBG tile sw=" << sw << " sh=" << sh << " min=" << tmin << " max=" << tmax
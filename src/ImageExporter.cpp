@@ -1,6 +1,18 @@
 #include "rawproc/ImageExporter.h"
+#include "rawproc/PAL/File.h"
+#include "rawproc/PixelKernels.h"
+#include "rawproc/ThreadPool.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <fstream>
+#include <string>
 #include <vector>
 #include <cstring>
 
@@ -14,111 +26,486 @@
 
 namespace rawproc {
 
-static inline unsigned char clamp8(float v) {
-    if (v < 0.0f) v = 0.0f; if (v > 1.0f) v = 1.0f; return static_cast<unsigned char>(v * 255.0f + 0.5f);
-}
-
-// Very small PPM writer as a stand-in for PNG/JPG, to avoid external deps in scaffold.
-static bool write_ppm(const std::filesystem::path& path, const RgbImageF& img) {
-    std::ofstream f(path, std::ios::binary);
-    if (!f) return false;
-    f << "P6\n" << img.width << " " << img.height << "\n255\n";
-    for (size_t i = 0; i < img.data.size(); i += 3) {
-        unsigned char r = clamp8(img.data[i + 0]);
-        unsigned char g = clamp8(img.data[i + 1]);
-        unsigned char b = clamp8(img.data[i + 2]);
-        f.write(reinterpret_cast<const char*>(&r), 1);
-        f.write(reinterpret_cast<const char*>(&g), 1);
-        f.write(reinterpret_cast<const char*>(&b), 1);
+namespace {
+#if defined(RAWPROC_HAVE_STB) || defined(RAWPROC_HAVE_ZLIB)
+constexpr bool kHavePngEncoder = true;
+#else
+constexpr bool kHavePngEncoder = false;
+#endif
+#if defined(RAWPROC_HAVE_STB)
+constexpr bool kHaveJpgEncoder = true;
+// stb's PNG level and filter are process-wide globals: setting them and encoding has to be one
+// step, or concurrent writers (async queue, several exporters) use each other's settings.
+std::mutex stbPngMutex;
+#else
+constexpr bool kHaveJpgEncoder = false;
+#endif
+
+std::filesystem::path asPpm(const std::filesystem::path& path) {
+    auto out = path;
+    if (out.extension() != ".ppm") out.replace_extension(".ppm");
+    return out;
+}
+
+// Copies rendered tiles into one frame for encoders without a tile path.
+RgbImageF assemble(const RgbTileSet& ts, ITaskScheduler& sched) {
+    RgbImageF img;
+    img.width = ts.width;
+    img.height = ts.height;
+    img.data.resize(static_cast<size_t>(ts.width) * ts.height * 3u, 0.0f);
+    sched.parallelFor(ts.tiles.size(), 1, [&](size_t t0, size_t t1) {
+        for (size_t ti = t0; ti < t1; ++ti) {
+            const auto& t = ts.tiles[ti];
+            if (!t.data || t.data->size() < static_cast<size_t>(t.width) * t.height * 3u) continue;
+            const int x0 = std::max(0, t.x), y0 = std::max(0, t.y);
+            const int x1 = std::min<int>(static_cast<int>(ts.width), t.x + static_cast<int>(t.width));
+            const int y1 = std::min<int>(static_cast<int>(ts.height), t.y + static_cast<int>(t.height));
+            if (x1 <= x0) continue;
+            for (int y = y0; y < y1; ++y) {
+                const float* src = t.data->data() + (static_cast<size_t>(y - t.y) * t.width + (x0 - t.x)) * 3u;
+                std::copy(src, src + static_cast<size_t>(x1 - x0) * 3u,
+                          img.data.begin() + (static_cast<size_t>(y) * ts.width + x0) * 3u);
+            }
+        }
+    });
+    return img;
+}
+} // namespace
+
+// Binary PNM writer (P5 gray / P6 RGB, maxval 255 or 65535), also the stand-in for PNG/JPG when
+// no encoder is compiled in. Row bands are converted in parallel into band buffers and each band
+// is written with a single positioned write, so there is neither a full-frame 8/16-bit copy nor
+// a stream call per sample.
+static bool write_pnm(const std::filesystem::path& path, uint32_t channels, uint32_t w, uint32_t h, int bits,
+                      ITaskScheduler* sched, const std::function<void(uint32_t, uint32_t, uint8_t*)>& convert) {
+    if (w == 0 || h == 0 || (channels != 1 && channels != 3) || (bits != 8 && bits != 16)) return false;
+    const std::string header = std::string(channels == 1 ? "P5" : "P6") + "\n" + std::to_string(w) + " " +
+                               std::to_string(h) + "\n" + (bits == 16 ? "65535" : "255") + "\n";
+    pal::OutputFile f;
+    if (!f.open(path) || !f.writeAt(header.data(), header.size(), 0)) return false;
+
+    const size_t rowBytes = static_cast<size_t>(w) * channels * (bits / 8);
+    const size_t bandRows = std::max<size_t>(1, (1u << 20) / rowBytes); // ~1 MiB per write
+    std::atomic<bool> ok{true};
+    auto bands = [&](size_t y0, size_t y1) {
+        PixelBuffer<uint8_t> band(rowBytes * (y1 - y0));
+        convert(static_cast<uint32_t>(y0), static_cast<uint32_t>(y1), band.data());
+        if (!f.writeAt(band.data(), band.size(), header.size() + y0 * rowBytes)) ok = false;
+    };
+    if (sched) sched->parallelFor(h, bandRows, bands);
+    else bands(0, h);
+    return f.close() && ok;
+}
+
+ImageExporter::ImageExporter() = default;
+ImageExporter::~ImageExporter() = default;
+
+ITaskScheduler& ImageExporter::pool() {
+    if (!pool_) pool_ = std::make_shared<ThreadPool>();
+    return *pool_;
+}
+
+void ImageExporter::setScheduler(ITaskScheduler& sched) {
+    pool_ = std::shared_ptr<ITaskScheduler>(&sched, [](ITaskScheduler*) {}); // not owned
+}
+
+// Bounded job queue drained by dedicated writer threads. Each writer exports through its own
+// ImageExporter that shares the owner's pool and receives the owner's options per job.
+struct ImageExporter::AsyncQueue {
+    struct Job {
+        std::function<bool(ImageExporter&)> run;
+        std::function<void(bool)> onDone;
+        std::promise<bool> done;
+        QuantizeOptions quant;
+        PngOptions png;
+        ExrOptions exr;
+        TiffOptions tiff;
+    };
+
+    AsyncQueue(std::shared_ptr<ITaskScheduler> pool, size_t writers, size_t pending)
+        : maxPending(std::max<size_t>(1, pending)) {
+        for (size_t i = 0; i < std::max<size_t>(1, writers); ++i) threads.emplace_back([this, pool] { loop(pool); });
     }
-    return true;
+    ~AsyncQueue() {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            stop = true;
+        }
+        notEmpty.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    static AsyncQueue& of(ImageExporter& e) {
+        if (!e.async_) {
+            e.pool();
+            e.async_ = std::make_unique<AsyncQueue>(e.pool_, e.asyncWriters_, e.asyncPending_);
+        }
+        return *e.async_;
+    }
+
+    std::future<bool> submit(const ImageExporter& owner, std::function<bool(ImageExporter&)> run,
+                             std::function<void(bool)> onDone) {
+        Job job;
+        job.run = std::move(run);
+        job.onDone = std::move(onDone);
+        job.quant = owner.quant_;
+        job.png = owner.png_;
+        job.exr = owner.exr_;
+        job.tiff = owner.tiff_;
+        std::future<bool> fut = job.done.get_future();
+        {
+            std::unique_lock<std::mutex> lk(m);
+            notFull.wait(lk, [&] { return jobs.size() < maxPending; }); // backpressure
+            jobs.push_back(std::move(job));
+        }
+        notEmpty.notify_one();
+        return fut;
+    }
+
+    void waitIdle() {
+        std::unique_lock<std::mutex> lk(m);
+        idle.wait(lk, [&] { return jobs.empty() && running == 0; });
+    }
+
+    void loop(std::shared_ptr<ITaskScheduler> pool) {
+        ImageExporter local;
+        local.pool_ = std::move(pool);
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lk(m);
+                notEmpty.wait(lk, [&] { return stop || !jobs.empty(); });
+                if (jobs.empty()) return; // stopping and drained
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                ++running;
+            }
+            notFull.notify_one();
+
+            local.quant_ = job.quant;
+            local.png_ = job.png;
+            local.exr_ = job.exr;
+            local.tiff_ = job.tiff;
+            bool ok = false;
+            std::exception_ptr error;
+            try {
+                ok = job.run(local);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            job.run = nullptr; // release the image before signalling completion
+            if (job.onDone) {
+                try { job.onDone(ok && !error); } catch (...) {}
+            }
+            if (error) job.done.set_exception(error);
+            else job.done.set_value(ok);
+            {
+                std::lock_guard<std::mutex> lk(m);
+                --running;
+            }
+            idle.notify_all();
+        }
+    }
+
+    std::mutex m;
+    std::condition_variable notEmpty, notFull, idle;
+    std::deque<Job> jobs;
+    size_t running = 0;
+    bool stop = false;
+    const size_t maxPending;
+    std::vector<std::thread> threads;
+};
+
+bool ImageExporter::run(ExportFormat fmt, const std::filesystem::path& path, const RgbImageF& img) {
+    switch (fmt) {
+    case ExportFormat::PNG:   return exportPNG(path, img);
+    case ExportFormat::JPG:   return exportJPG(path, img);
+    case ExportFormat::PNG16: return exportPNG16(path, img);
+    case ExportFormat::TIFF:  return exportTIFF(path, img);
+    case ExportFormat::PPM:   return exportPPM(path, img);
+    case ExportFormat::EXR:   return exportEXR(path, img);
+    }
+    return false;
 }
 
-bool ImageExporter::exportPNG(const std::filesystem::path& path, const RgbImageF& img) {
+std::future<bool> ImageExporter::exportAsync(std::filesystem::path path, RgbImageF img, ExportFormat fmt,
+                                             std::function<void(bool)> onDone) {
+    return AsyncQueue::of(*this).submit(*this, [path = std::move(path), img = std::move(img), fmt](ImageExporter& e) {
+        return e.run(fmt, path, img);
+    }, std::move(onDone));
+}
+
+std::future<bool> ImageExporter::exportAsync(std::filesystem::path path, RgbTileSet tiles, ExportFormat fmt,
+                                             std::function<void(bool)> onDone) {
+    return AsyncQueue::of(*this).submit(*this, [path = std::move(path), tiles = std::move(tiles), fmt](ImageExporter& e) {
+        switch (fmt) {
+        case ExportFormat::PNG: return e.exportPNG(path, tiles);
+        case ExportFormat::JPG: return e.exportJPG(path, tiles);
+        case ExportFormat::EXR: return e.exportEXR(path, tiles);
+        default:                return e.run(fmt, path, assemble(tiles, e.pool()));
+        }
+    }, std::move(onDone));
+}
+
+void ImageExporter::setAsyncLimits(size_t writers, size_t maxPending) {
+    asyncWriters_ = writers;
+    asyncPending_ = maxPending;
+}
+
+void ImageExporter::waitIdle() {
+    if (async_) async_->waitIdle();
+}
+
+bool ImageExporter::write8(const std::filesystem::path& path, const PixelBuffer<uint8_t>& buf, uint32_t w, uint32_t h,
+                           bool jpg, int quality) {
+    if (buf.size() < static_cast<size_t>(w) * h * 3u) return false;
+#if defined(RAWPROC_HAVE_ZLIB)
+    if (!jpg && png_.parallel) return writePngParallel(path, buf.data(), w, h, 3, png_, &pool());
+#endif
 #if defined(RAWPROC_HAVE_STB)
-    // Convert to 8-bit interleaved
-    std::vector<unsigned char> buf(static_cast<size_t>(img.width) * img.height * 3u);
-    for (size_t i = 0; i < buf.size(); i += 3) {
-        buf[i + 0] = clamp8(img.data[i + 0]);
-        buf[i + 1] = clamp8(img.data[i + 1]);
-        buf[i + 2] = clamp8(img.data[i + 2]);
+    int ok = 0;
+    if (jpg) {
+        ok = stbi_write_jpg(path.string().c_str(), static_cast<int>(w), static_cast<int>(h), 3, buf.data(), quality);
+    } else {
+        std::lock_guard<std::mutex> lk(stbPngMutex);
+        stbi_write_png_compression_level = png_.compression;
+        stbi_write_force_png_filter = png_.filter == PngFilter::Adaptive ? -1 : static_cast<int>(png_.filter);
+        ok = stbi_write_png(path.string().c_str(), static_cast<int>(w), static_cast<int>(h), 3, buf.data(), static_cast<int>(w * 3));
     }
-    int ok = stbi_write_png(path.string().c_str(), static_cast<int>(img.width), static_cast<int>(img.height), 3, buf.data(), static_cast<int>(img.width * 3));
     return ok != 0;
 #else
-    auto out = path;
-    if (out.extension() != ".ppm") out.replace_extension(".ppm");
-    return write_ppm(out, img);
+  #if defined(RAWPROC_HAVE_ZLIB)
+    if (!jpg) return writePngParallel(path, buf.data(), w, h, 3, png_, &pool());
+  #endif
+    (void)quality;
+    const size_t rowBytes = static_cast<size_t>(w) * 3u;
+    return write_pnm(asPpm(path), 3, w, h, 8, &pool(), [&](uint32_t y0, uint32_t y1, uint8_t* dst) {
+        std::memcpy(dst, buf.data() + y0 * rowBytes, (y1 - y0) * rowBytes);
+    });
 #endif
 }
 
+bool ImageExporter::exportPNG(const std::filesystem::path& path, const RgbImageF& img) {
+    if (!kHavePngEncoder) return exportPPM(asPpm(path), img, 8);
+    return write8(path, quantizeU8(img, quant_, &pool()), img.width, img.height, false, 0);
+}
+
 bool ImageExporter::exportJPG(const std::filesystem::path& path, const RgbImageF& img, int quality) {
-#if defined(RAWPROC_HAVE_STB)
-    std::vector<unsigned char> buf(static_cast<size_t>(img.width) * img.height * 3u);
-    for (size_t i = 0; i < buf.size(); i += 3) {
-        buf[i + 0] = clamp8(img.data[i + 0]);
-        buf[i + 1] = clamp8(img.data[i + 1]);
-        buf[i + 2] = clamp8(img.data[i + 2]);
-    }
-    int ok = stbi_write_jpg(path.string().c_str(), static_cast<int>(img.width), static_cast<int>(img.height), 3, buf.data(), quality);
-    return ok != 0;
+    if (!kHaveJpgEncoder) return exportPPM(asPpm(path), img, 8);
+    return write8(path, quantizeU8(img, quant_, &pool()), img.width, img.height, true, quality);
+}
+
+bool ImageExporter::exportPNG(const std::filesystem::path& path, const RgbTileSet& tiles) {
+    if (!kHavePngEncoder) return exportPPM(asPpm(path), assemble(tiles, pool()), 8);
+    return write8(path, quantizeU8(tiles, quant_, &pool()), tiles.width, tiles.height, false, 0);
+}
+
+bool ImageExporter::exportJPG(const std::filesystem::path& path, const RgbTileSet& tiles, int quality) {
+    if (!kHaveJpgEncoder) return exportPPM(asPpm(path), assemble(tiles, pool()), 8);
+    return write8(path, quantizeU8(tiles, quant_, &pool()), tiles.width, tiles.height, true, quality);
+}
+
+bool ImageExporter::exportPPM(const std::filesystem::path& path, const RgbImageF& img, int bitDepth) {
+    if (img.data.size() < static_cast<size_t>(img.width) * img.height * 3u) return false;
+    const size_t stride = static_cast<size_t>(img.width) * 3u;
+    return write_pnm(path, 3, img.width, img.height, bitDepth, &pool(), [&](uint32_t y0, uint32_t y1, uint8_t* dst) {
+        const float* src = img.data.data() + y0 * stride;
+        if (bitDepth == 16) {
+            quantizeRowsU16(src, stride, reinterpret_cast<uint16_t*>(dst), stride, img.width, y1 - y0, 3, true);
+        } else {
+            quantizeRowsU8(src, stride, dst, stride, img.width, y1 - y0, 3, 0, static_cast<int>(y0), quant_);
+        }
+    });
+}
+
+bool ImageExporter::exportPNG16(const std::filesystem::path& path, const RgbImageF& img) {
+    if (img.data.size() < static_cast<size_t>(img.width) * img.height * 3u) return false;
+#if defined(RAWPROC_HAVE_ZLIB)
+    const size_t stride = static_cast<size_t>(img.width) * 3u;
+    return writePngParallel(path, img.width, img.height, 3, 16, [&](uint32_t y0, uint32_t y1, uint8_t* dst) {
+        quantizeRowsU16(img.data.data() + y0 * stride, stride, reinterpret_cast<uint16_t*>(dst), stride,
+                        img.width, y1 - y0, 3, true);
+    }, png_, png_.parallel ? &pool() : nullptr);
 #else
-    auto out = path;
-    if (out.extension() != ".ppm") out.replace_extension(".ppm");
-    return write_ppm(out, img);
+    return exportPPM(asPpm(path), img, 16);
 #endif
 }
 
-bool ImageExporter::exportEXR(const std::filesystem::path& path, const RgbImageF& img) {
-#if defined(RAWPROC_HAVE_TINYEXR)
-    const int w = static_cast<int>(img.width);
-    const int h = static_cast<int>(img.height);
-    // TinyEXR expects separate channel arrays (B,G,R,A) in this order.
-    std::vector<float> R(w * h), G(w * h), B(w * h);
-    for (int y = 0; y < h; ++y) {
-        for (int x = 0; x < w; ++x) {
-            size_t i = (static_cast<size_t>(y) * w + x) * 3u;
-            size_t j = static_cast<size_t>(y) * w + x;
-            R[j] = img.data[i + 0];
-            G[j] = img.data[i + 1];
-            B[j] = img.data[i + 2];
+bool ImageExporter::exportTIFF(const std::filesystem::path& path, const RgbImageF& img, int bitDepth) {
+    if (img.data.size() < static_cast<size_t>(img.width) * img.height * 3u) return false;
+    const size_t stride = static_cast<size_t>(img.width) * 3u;
+    return writeTiff(path, img.width, img.height, 3, bitDepth, [&](uint32_t y0, uint32_t y1, uint8_t* dst) {
+        const float* src = img.data.data() + y0 * stride;
+        if (bitDepth == 16) {
+            // Little-endian samples to match the "II" byte order
+            quantizeRowsU16(src, stride, reinterpret_cast<uint16_t*>(dst), stride, img.width, y1 - y0, 3, false);
+        } else {
+            quantizeRowsU8(src, stride, dst, stride, img.width, y1 - y0, 3, 0, static_cast<int>(y0), quant_);
+        }
+    }, tiff_, &pool());
+}
+
+bool ImageExporter::exportPGM(const std::filesystem::path& path, const RawImage& raw) {
+    if (!raw.isView() && raw.data.size() < static_cast<size_t>(raw.width) * raw.height) return false;
+    const uint16_t one = 1;
+    const bool hostLittle = *reinterpret_cast<const uint8_t*>(&one) == 1;
+    return write_pnm(path, 1, raw.width, raw.height, 16, &pool(), [&](uint32_t y0, uint32_t y1, uint8_t* dst) {
+        uint16_t* d = reinterpret_cast<uint16_t*>(dst);
+        for (uint32_t y = y0; y < y1; ++y, d += raw.width) {
+            const uint16_t* src = raw.row(y);
+            // PNM samples are big-endian
+            for (uint32_t i = 0; i < raw.width; ++i) d[i] = hostLittle ? static_cast<uint16_t>((src[i] >> 8) | (src[i] << 8)) : src[i];
         }
+    });
+}
+
+#if defined(RAWPROC_HAVE_TINYEXR)
+namespace {
+
+// Interleaved RGB source region (the whole frame, or one rendered tile).
+struct RgbBlock {
+    int x = 0, y = 0, w = 0, h = 0;
+    const float* data = nullptr;
+    size_t stride = 0; // floats per row
+};
+
+// Writes a tiled, single-level EXR. Each EXR tile's B,G,R planes are filled in parallel straight
+// from the interleaved source blocks (no full-frame de-interleave), converted to half up front
+// when requested; TinyEXR then compresses the tiles on its worker threads.
+bool writeTiledExr(const std::filesystem::path& path, uint32_t width, uint32_t height,
+                   const std::vector<RgbBlock>& blocks, const ExrOptions& opt, ITaskScheduler* sched) {
+    if (width == 0 || height == 0) return false;
+    const int W = static_cast<int>(width), H = static_cast<int>(height);
+    const int ts = std::max(16, opt.tileSize);
+    const int tsx = std::min(ts, W), tsy = std::min(ts, H);
+    const int ntx = (W + tsx - 1) / tsx, nty = (H + tsy - 1) / tsy;
+    const size_t ntiles = static_cast<size_t>(ntx) * nty;
+    const size_t bps = opt.half ? sizeof(uint16_t) : sizeof(float);
+
+    // Bucket source blocks by the EXR tiles they overlap.
+    std::vector<std::vector<const RgbBlock*>> bucket(ntiles);
+    for (const auto& b : blocks) {
+        if (!b.data || b.w <= 0 || b.h <= 0) continue;
+        const int tx0 = std::max(0, b.x) / tsx, ty0 = std::max(0, b.y) / tsy;
+        const int tx1 = std::min(ntx - 1, (std::min(W, b.x + b.w) - 1) / tsx);
+        const int ty1 = std::min(nty - 1, (std::min(H, b.y + b.h) - 1) / tsy);
+        for (int ty = ty0; ty <= ty1; ++ty)
+            for (int tx = tx0; tx <= tx1; ++tx) bucket[static_cast<size_t>(ty) * ntx + tx].push_back(&b);
     }
-    const float* channels[3];
-    channels[0] = B.data();
-    channels[1] = G.data();
-    channels[2] = R.data();
+
+    std::vector<EXRTile> tiles(ntiles);
+    std::vector<std::vector<uint8_t>> planes(ntiles);  // per tile: B | G | R
+    std::vector<std::array<unsigned char*, 3>> ptrs(ntiles);
+    auto fill = [&](size_t t0, size_t t1) {
+        for (size_t t = t0; t < t1; ++t) {
+            const int tx = static_cast<int>(t % ntx), ty = static_cast<int>(t / ntx);
+            const int x0 = tx * tsx, y0 = ty * tsy;
+            const int tw = std::min(tsx, W - x0), th = std::min(tsy, H - y0);
+            // TinyEXR reads every tile plane with a row stride of the full tile width.
+            const size_t n = static_cast<size_t>(tsx) * tsy;
+            planes[t].assign(n * 3 * bps, 0); // uncovered pixels stay black
+            uint8_t* base = planes[t].data();
+            for (int c = 0; c < 3; ++c) ptrs[t][c] = base + static_cast<size_t>(c) * n * bps;
+            for (const RgbBlock* b : bucket[t]) {
+                const int ix0 = std::max(x0, b->x), ix1 = std::min(x0 + tw, b->x + b->w);
+                const int iy0 = std::max(y0, b->y), iy1 = std::min(y0 + th, b->y + b->h);
+                if (ix1 <= ix0 || iy1 <= iy0) continue;
+                const uint32_t w = static_cast<uint32_t>(ix1 - ix0), h = static_cast<uint32_t>(iy1 - iy0);
+                const float* src = b->data + static_cast<size_t>(iy0 - b->y) * b->stride + static_cast<size_t>(ix0 - b->x) * 3u;
+                const size_t d0 = (static_cast<size_t>(iy0 - y0) * tsx + (ix0 - x0)) * bps;
+                // EXR channel order is alphabetical: B, G, R
+                const void* rgbPlanes[3] = {ptrs[t][2] + d0, ptrs[t][1] + d0, ptrs[t][0] + d0};
+                convertPixels(PixelRect::interleaved(src, PixelFormat::F32, 3, w, h, b->stride),
+                              PixelRect::planar(rgbPlanes, 3, opt.half ? PixelFormat::F16 : PixelFormat::F32, w, h, tsx));
+            }
+            EXRTile& et = tiles[t];
+            et.offset_x = tx; et.offset_y = ty;
+            et.level_x = 0; et.level_y = 0;
+            et.width = tw; et.height = th;
+            et.images = ptrs[t].data();
+        }
+    };
+    if (sched) sched->parallelFor(ntiles, 1, fill);
+    else fill(0, ntiles);
+
     EXRHeader header; InitEXRHeader(&header);
-    EXRImage image;  InitEXRImage(&image);
+    EXRImage image; InitEXRImage(&image);
     image.num_channels = 3;
-    image.images = (unsigned char**)channels;
-    image.width = w;
-    image.height = h;
-    header.num_channels = 3;
-    header.channels = (EXRChannelInfo*)malloc(sizeof(EXRChannelInfo) * header.num_channels);
-    strncpy(header.channels[0].name, "B", 255);
-    strncpy(header.channels[1].name, "G", 255);
-    strncpy(header.channels[2].name, "R", 255);
-    header.pixel_types = (int*)malloc(sizeof(int) * header.num_channels);
-    header.requested_pixel_types = (int*)malloc(sizeof(int) * header.num_channels);
-    for (int i = 0; i < header.num_channels; i++) {
-        header.pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
-        header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_HALF;
+    image.width = W;
+    image.height = H;
+    image.tiles = tiles.data();
+    image.num_tiles = static_cast<int>(ntiles);
+    // Tiled layout is derived from the header windows, not from image.width/height.
+    header.data_window.max_x = header.display_window.max_x = W - 1;
+    header.data_window.max_y = header.display_window.max_y = H - 1;
+    header.tiled = 1;
+    header.tile_size_x = tsx;
+    header.tile_size_y = tsy;
+    header.tile_level_mode = TINYEXR_TILE_ONE_LEVEL;
+    header.tile_rounding_mode = TINYEXR_TILE_ROUND_DOWN;
+    switch (opt.compression) {
+    case ExrCompression::None: header.compression_type = TINYEXR_COMPRESSIONTYPE_NONE; break;
+    case ExrCompression::Zip:  header.compression_type = TINYEXR_COMPRESSIONTYPE_ZIP; break;
+    case ExrCompression::Piz:  header.compression_type = TINYEXR_COMPRESSIONTYPE_PIZ; break;
     }
+    EXRChannelInfo channels[3];
+    std::memset(channels, 0, sizeof(channels));
+    std::strncpy(channels[0].name, "B", 255);
+    std::strncpy(channels[1].name, "G", 255);
+    std::strncpy(channels[2].name, "R", 255);
+    const int ptype = opt.half ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT;
+    int pixelTypes[3] = {ptype, ptype, ptype};
+    int requestedTypes[3] = {ptype, ptype, ptype};
+    header.num_channels = 3;
+    header.channels = channels;
+    header.pixel_types = pixelTypes;
+    header.requested_pixel_types = requestedTypes;
+
     const char* err = nullptr;
-    int ret = SaveEXRImageToFile(&image, &header, path.string().c_str(), &err);
-    free(header.channels);
-    free(header.pixel_types);
-    free(header.requested_pixel_types);
+    const int ret = SaveEXRImageToFile(&image, &header, path.string().c_str(), &err);
     if (ret != TINYEXR_SUCCESS) {
         if (err) FreeEXRErrorMessage(err);
         return false;
     }
     return true;
+}
+
+} // namespace
+#endif // RAWPROC_HAVE_TINYEXR
+
+bool ImageExporter::exportEXR(const std::filesystem::path& path, const RgbImageF& img) {
+#if defined(RAWPROC_HAVE_TINYEXR)
+    if (img.data.size() < static_cast<size_t>(img.width) * img.height * 3u) return false;
+    RgbBlock b;
+    b.w = static_cast<int>(img.width);
+    b.h = static_cast<int>(img.height);
+    b.data = img.data.data();
+    b.stride = static_cast<size_t>(img.width) * 3u;
+    return writeTiledExr(path, img.width, img.height, {b}, exr_, &pool());
 #else
     (void)path; (void)img;
     return false;
 #endif
 }
 
+bool ImageExporter::exportEXR(const std::filesystem::path& path, const RgbTileSet& ts) {
+#if defined(RAWPROC_HAVE_TINYEXR)
+    std::vector<RgbBlock> blocks;
+    blocks.reserve(ts.tiles.size());
+    for (const auto& t : ts.tiles) {
+        if (!t.data || t.data->size() < static_cast<size_t>(t.width) * t.height * 3u) continue;
+        RgbBlock b;
+        b.x = t.x; b.y = t.y;
+        b.w = static_cast<int>(t.width); b.h = static_cast<int>(t.height);
+        b.data = t.data->data();
+        b.stride = static_cast<size_t>(t.width) * 3u;
+        blocks.push_back(b);
+    }
+    return writeTiledExr(path, ts.width, ts.height, blocks, exr_, &pool());
+#else
+    (void)path; (void)ts;
+    return false;
+#endif
+}
+
 } // namespace rawproc
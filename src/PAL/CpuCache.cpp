@@ -0,0 +1,51 @@
+#include "rawproc/PAL/CpuCache.h"
+#include "rawproc/PAL/Numa.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+namespace rawproc::pal {
+
+size_t parseCacheSize(const std::string& s) {
+    char* end = nullptr;
+    const unsigned long long v = std::strtoull(s.c_str(), &end, 10);
+    if (end == s.c_str()) return 0;
+    switch (*end) {
+    case 'K': case 'k': return static_cast<size_t>(v) << 10;
+    case 'M': case 'm': return static_cast<size_t>(v) << 20;
+    case 'G': case 'g': return static_cast<size_t>(v) << 30;
+    default: return static_cast<size_t>(v);
+    }
+}
+
+CpuCacheInfo CpuCacheInfo::detect() {
+    CpuCacheInfo info;
+#if defined(__linux__)
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    const fs::path root = "/sys/devices/system/cpu/cpu0/cache";
+    auto readLine = [](const fs::path& p) {
+        std::ifstream f(p);
+        std::string line;
+        if (f) std::getline(f, line);
+        return line;
+    };
+    for (auto it = fs::directory_iterator(root, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        if (it->path().filename().string().rfind("index", 0) != 0) continue;
+        const std::string type = readLine(it->path() / "type");
+        if (type != "Data" && type != "Unified") continue;
+        const int level = std::atoi(readLine(it->path() / "level").c_str());
+        const size_t size = parseCacheSize(readLine(it->path() / "size"));
+        if (size == 0) continue;
+        const size_t shared = parseCpuList(readLine(it->path() / "shared_cpu_list").c_str()).size();
+        const unsigned sharedBy = shared ? static_cast<unsigned>(shared) : 1u;
+        if (level == 1) info.l1d = size;
+        else if (level == 2) { info.l2 = size; info.l2SharedBy = sharedBy; }
+        else if (level == 3) { info.l3 = size; info.l3SharedBy = sharedBy; }
+    }
+#endif
+    return info;
+}
+
+} // namespace rawproc::pal
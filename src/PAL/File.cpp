@@ -0,0 +1,68 @@
+#include "rawproc/PAL/File.h"
+
+#include <cstdio>
+
+#if defined(_WIN32)
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <cerrno>
+#endif
+
+namespace rawproc::pal {
+
+#if !defined(_WIN32)
+namespace {
+inline int fdOf(void* h) { return static_cast<int>(reinterpret_cast<intptr_t>(h)) - 1; }
+}
+#endif
+
+OutputFile::~OutputFile() { close(); }
+
+bool OutputFile::open(const std::filesystem::path& path) {
+    close();
+#if defined(_WIN32)
+    FILE* f = ::_wfopen(path.wstring().c_str(), L"wb");
+    handle_ = f;
+#else
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    handle_ = fd >= 0 ? reinterpret_cast<void*>(static_cast<intptr_t>(fd) + 1) : nullptr;
+#endif
+    return handle_ != nullptr;
+}
+
+bool OutputFile::writeAt(const void* data, size_t size, uint64_t offset) {
+    if (!handle_) return false;
+#if defined(_WIN32)
+    std::lock_guard<std::mutex> lk(m_);
+    FILE* f = static_cast<FILE*>(handle_);
+    if (::_fseeki64(f, static_cast<__int64>(offset), SEEK_SET) != 0) return false;
+    return std::fwrite(data, 1, size, f) == size;
+#else
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t n = ::pwrite(fdOf(handle_), p, size, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n; size -= static_cast<size_t>(n); offset += static_cast<uint64_t>(n);
+    }
+    return true;
+#endif
+}
+
+bool OutputFile::close() {
+    if (!handle_) return true;
+#if defined(_WIN32)
+    const bool ok = std::fclose(static_cast<FILE*>(handle_)) == 0;
+#else
+    const bool ok = ::close(fdOf(handle_)) == 0;
+#endif
+    handle_ = nullptr;
+    return ok;
+}
+
+} // namespace rawproc::pal
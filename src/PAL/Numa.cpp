@@ -0,0 +1,82 @@
+#include "rawproc/PAL/Numa.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+  #include <pthread.h>
+  #include <sched.h>
+#endif
+
+namespace rawproc::pal {
+
+std::vector<int> parseCpuList(const char* s) {
+    std::vector<int> cpus;
+    if (!s) return cpus;
+    while (*s) {
+        char* end = nullptr;
+        long a = std::strtol(s, &end, 10);
+        if (end == s) { ++s; continue; }
+        long b = a;
+        s = end;
+        if (*s == '-') {
+            ++s;
+            b = std::strtol(s, &end, 10);
+            if (end == s) b = a;
+            s = end;
+        }
+        for (long c = a; c <= b; ++c) cpus.push_back(static_cast<int>(c));
+        if (*s == ',') ++s;
+    }
+    return cpus;
+}
+
+NumaTopology NumaTopology::detect() {
+    NumaTopology topo;
+#if defined(__linux__)
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    const fs::path root = "/sys/devices/system/node";
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    for (auto it = fs::directory_iterator(root, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        const std::string name = it->path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() <= 4) continue;
+        if (!std::all_of(name.begin() + 4, name.end(), [](char c){ return c >= '0' && c <= '9'; })) continue;
+        std::ifstream f(it->path() / "cpulist");
+        std::string line;
+        if (!f || !std::getline(f, line)) continue;
+        auto cpus = parseCpuList(line.c_str());
+        // Memory-only nodes have no CPUs to schedule on.
+        if (cpus.empty()) continue;
+        nodes.emplace_back(std::atoi(name.c_str() + 4), std::move(cpus));
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const auto& a, const auto& b){ return a.first < b.first; });
+    for (auto& n : nodes) topo.nodeCpus.push_back(std::move(n.second));
+#endif
+    if (topo.nodeCpus.empty()) {
+        std::vector<int> all;
+        const unsigned n = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < n; ++i) all.push_back(static_cast<int>(i));
+        topo.nodeCpus.push_back(std::move(all));
+    }
+    return topo;
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+} // namespace rawproc::pal
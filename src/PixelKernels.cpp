@@ -0,0 +1,79 @@
+#include "rawproc/PixelKernels.h"
+
+#include <cmath>
+
+namespace rawproc {
+
+namespace {
+
+using Kernel = void (*)(const PixelRect&, const PixelRect&, const ConvertParams&);
+
+template <PixelFormat SF, PixelFormat DF, uint32_t SC, uint32_t DC>
+Kernel pickLayout(PixelLayout sl, PixelLayout dl) {
+    constexpr PixelLayout I = PixelLayout::Interleaved, P = PixelLayout::Planar;
+    if (sl == I) return dl == I ? kernels::convertRect<SF, DF, SC, DC, I, I> : kernels::convertRect<SF, DF, SC, DC, I, P>;
+    return dl == I ? kernels::convertRect<SF, DF, SC, DC, P, I> : kernels::convertRect<SF, DF, SC, DC, P, P>;
+}
+
+template <PixelFormat SF, PixelFormat DF>
+Kernel pickChannels(const PixelRect& src, const PixelRect& dst, const ConvertParams& p) {
+    if (src.channels == 1 && dst.channels == 1) return pickLayout<SF, DF, 1, 1>(src.layout, dst.layout);
+    if (src.channels == 1 && dst.channels == 3) return pickLayout<SF, DF, 1, 3>(src.layout, dst.layout);
+    if (src.channels == 3 && dst.channels == 3) return pickLayout<SF, DF, 3, 3>(src.layout, dst.layout);
+    if (src.channels == 3 && dst.channels == 4 && dst.layout == PixelLayout::Interleaved) {
+        constexpr PixelLayout I = PixelLayout::Interleaved, P = PixelLayout::Planar;
+        if (src.layout == I) return p.swapRB ? kernels::convertRect<SF, DF, 3, 4, I, I, true> : kernels::convertRect<SF, DF, 3, 4, I, I>;
+        return p.swapRB ? kernels::convertRect<SF, DF, 3, 4, P, I, true> : kernels::convertRect<SF, DF, 3, 4, P, I>;
+    }
+    return nullptr;
+}
+
+template <PixelFormat SF>
+Kernel pickDst(const PixelRect& src, const PixelRect& dst, const ConvertParams& p) {
+    switch (dst.format) {
+    case PixelFormat::U8:  return pickChannels<SF, PixelFormat::U8>(src, dst, p);
+    case PixelFormat::U16: return pickChannels<SF, PixelFormat::U16>(src, dst, p);
+    case PixelFormat::F16: return pickChannels<SF, PixelFormat::F16>(src, dst, p);
+    case PixelFormat::F32: return pickChannels<SF, PixelFormat::F32>(src, dst, p);
+    }
+    return nullptr;
+}
+
+Kernel pick(const PixelRect& src, const PixelRect& dst, const ConvertParams& p) {
+    switch (src.format) {
+    case PixelFormat::U8:  return pickDst<PixelFormat::U8>(src, dst, p);
+    case PixelFormat::U16: return pickDst<PixelFormat::U16>(src, dst, p);
+    case PixelFormat::F16: return pickDst<PixelFormat::F16>(src, dst, p);
+    case PixelFormat::F32: return pickDst<PixelFormat::F32>(src, dst, p);
+    }
+    return nullptr;
+}
+
+bool isIdentity(const ConvertParams& p) {
+    return p.bias == 0.0f && p.scale == 1.0f && std::isinf(p.lo) && p.lo < 0.0f && std::isinf(p.hi) && p.hi > 0.0f;
+}
+
+} // namespace
+
+bool convertPixels(const PixelRect& src, const PixelRect& dst, const ConvertParams& p) {
+    if (dst.width == 0 || dst.height == 0) return true;
+    if (src.width < dst.width || src.height < dst.height) return false;
+    if (src.format == dst.format && src.channels == dst.channels && src.layout == dst.layout && isIdentity(p)) {
+        const size_t es = pixelFormatSize(src.format);
+        const uint32_t planes = src.layout == PixelLayout::Interleaved ? 1 : src.channels;
+        const size_t rowBytes = static_cast<size_t>(dst.width) * es * (planes == 1 ? src.channels : 1);
+        for (uint32_t c = 0; c < planes; ++c) {
+            for (uint32_t y = 0; y < dst.height; ++y) {
+                std::memcpy(static_cast<uint8_t*>(dst.planes[c]) + y * dst.stride * es,
+                            static_cast<const uint8_t*>(src.planes[c]) + y * src.stride * es, rowBytes);
+            }
+        }
+        return true;
+    }
+    const Kernel k = pick(src, dst, p);
+    if (!k) return false;
+    k(src, dst, p);
+    return true;
+}
+
+} // namespace rawproc
@@ -0,0 +1,247 @@
+#include "rawproc/PngEncoder.h"
+#include "rawproc/ImageTypes.h"
+
+#if defined(RAWPROC_HAVE_ZLIB)
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace rawproc {
+
+namespace {
+
+inline uint8_t paeth(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+// Writes filter type byte + filtered row to `out`. `prev` is the previous unfiltered row
+// (all zeros for the first row of the image).
+void filterRow(PngFilter f, const uint8_t* cur, const uint8_t* prev, size_t n, size_t bpp, uint8_t* out) {
+    out[0] = static_cast<uint8_t>(f);
+    uint8_t* o = out + 1;
+    switch (f) {
+    case PngFilter::None:
+        std::memcpy(o, cur, n);
+        break;
+    case PngFilter::Sub:
+        for (size_t i = 0; i < n; ++i) o[i] = static_cast<uint8_t>(cur[i] - (i >= bpp ? cur[i - bpp] : 0));
+        break;
+    case PngFilter::Up:
+        for (size_t i = 0; i < n; ++i) o[i] = static_cast<uint8_t>(cur[i] - prev[i]);
+        break;
+    case PngFilter::Average:
+        for (size_t i = 0; i < n; ++i) {
+            const int a = i >= bpp ? cur[i - bpp] : 0;
+            o[i] = static_cast<uint8_t>(cur[i] - ((a + prev[i]) >> 1));
+        }
+        break;
+    case PngFilter::Paeth:
+        for (size_t i = 0; i < n; ++i) {
+            const int a = i >= bpp ? cur[i - bpp] : 0;
+            const int c = i >= bpp ? prev[i - bpp] : 0;
+            o[i] = static_cast<uint8_t>(cur[i] - paeth(a, prev[i], c));
+        }
+        break;
+    case PngFilter::Adaptive:
+        break;
+    }
+}
+
+size_t residualCost(const uint8_t* o, size_t n) {
+    size_t s = 0;
+    for (size_t i = 0; i < n; ++i) s += static_cast<size_t>(std::abs(static_cast<int>(static_cast<int8_t>(o[i]))));
+    return s;
+}
+
+void filterRowAuto(PngFilter f, const uint8_t* cur, const uint8_t* prev, size_t n, size_t bpp,
+                   uint8_t* out, std::vector<uint8_t>& scratch) {
+    if (f != PngFilter::Adaptive) { filterRow(f, cur, prev, n, bpp, out); return; }
+    scratch.resize(n + 1);
+    size_t best = static_cast<size_t>(-1);
+    for (int k = 0; k <= 4; ++k) {
+        filterRow(static_cast<PngFilter>(k), cur, prev, n, bpp, scratch.data());
+        const size_t cost = residualCost(scratch.data() + 1, n);
+        if (cost < best) { best = cost; std::memcpy(out, scratch.data(), n + 1); }
+    }
+}
+
+void put32(std::vector<uint8_t>& v, uint32_t x) {
+    v.push_back(static_cast<uint8_t>(x >> 24)); v.push_back(static_cast<uint8_t>(x >> 16));
+    v.push_back(static_cast<uint8_t>(x >> 8));  v.push_back(static_cast<uint8_t>(x));
+}
+
+bool writeChunk(std::ofstream& f, const char type[4], const uint8_t* data, size_t len) {
+    std::vector<uint8_t> hdr;
+    put32(hdr, static_cast<uint32_t>(len));
+    hdr.insert(hdr.end(), type, type + 4);
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+    if (len) crc = crc32(crc, data, static_cast<uInt>(len));
+    std::vector<uint8_t> tail;
+    put32(tail, static_cast<uint32_t>(crc));
+    f.write(reinterpret_cast<const char*>(hdr.data()), static_cast<std::streamsize>(hdr.size()));
+    if (len) f.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(len));
+    f.write(reinterpret_cast<const char*>(tail.data()), static_cast<std::streamsize>(tail.size()));
+    return static_cast<bool>(f);
+}
+
+struct Band {
+    std::vector<uint8_t> deflated; // raw deflate, ends with sync flush (or final block)
+    uLong adler = 1;
+    size_t length = 0;             // filtered bytes covered
+    bool ok = false;
+};
+
+} // namespace
+
+bool writePngParallel(const std::filesystem::path& path, uint32_t width, uint32_t height,
+                      uint32_t channels, int bitDepth,
+                      const std::function<void(uint32_t, uint32_t, uint8_t*)>& rows,
+                      const PngOptions& opt, ITaskScheduler* sched) {
+    if (!rows || width == 0 || height == 0 || channels < 1 || channels > 4) return false;
+    if (bitDepth != 8 && bitDepth != 16) return false;
+    const size_t bpp = static_cast<size_t>(channels) * (bitDepth / 8);
+    const size_t rowBytes = static_cast<size_t>(width) * bpp;
+    const size_t fRow = rowBytes + 1;
+    const int level = std::clamp(opt.compression, 0, 9);
+
+    auto run = [&](size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+        if (sched) sched->parallelFor(count, grain, body);
+        else body(0, count);
+    };
+
+    // Bands should be large enough (>= 256 KiB) that the sync-flush overhead and the dictionary
+    // restart are negligible, and small enough (<= 2 MiB) that a wave of them stays cheap to hold.
+    const size_t workers = sched ? std::max<size_t>(1, sched->concurrency()) : 1;
+    uint32_t bandRows = opt.bandRows;
+    if (bandRows == 0) {
+        const size_t minRows = std::max<size_t>(1, (256u * 1024u + fRow - 1) / fRow);
+        const size_t maxRows = std::max(minRows, (2u * 1024u * 1024u) / fRow);
+        bandRows = static_cast<uint32_t>(std::clamp<size_t>((height + 2 * workers - 1) / (2 * workers), minRows, maxRows));
+    }
+    const size_t nBands = (height + bandRows - 1) / bandRows;
+    // Rows ahead of a band that are re-filtered to rebuild its 32 KiB dictionary.
+    const size_t dictRows = level > 0 ? (32768u + fRow - 1) / fRow : 0;
+    const std::vector<uint8_t> zeroRow(rowBytes, 0);
+
+    auto encode = [&](size_t b, Band& band) {
+        const size_t y0 = b * bandRows;
+        const size_t y1 = std::min<size_t>(height, y0 + bandRows);
+        const size_t c0 = y0 - std::min(y0, dictRows); // first filtered context row
+        const size_t p0 = c0 ? c0 - 1 : 0;             // plus its unfiltered predecessor
+        PixelBuffer<uint8_t> raw((y1 - p0) * rowBytes);
+        rows(static_cast<uint32_t>(p0), static_cast<uint32_t>(y1), raw.data());
+
+        PixelBuffer<uint8_t> filtered((y1 - c0) * fRow);
+        std::vector<uint8_t> scratch;
+        for (size_t y = c0; y < y1; ++y) {
+            const uint8_t* cur = raw.data() + (y - p0) * rowBytes;
+            const uint8_t* prev = y ? cur - rowBytes : zeroRow.data();
+            filterRowAuto(opt.filter, cur, prev, rowBytes, bpp, filtered.data() + (y - c0) * fRow, scratch);
+        }
+
+        const bool last = (b + 1 == nBands);
+        const size_t begin = (y0 - c0) * fRow;
+        band.length = (y1 - y0) * fRow;
+        z_stream zs{};
+        if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8,
+                         opt.filter == PngFilter::None ? Z_DEFAULT_STRATEGY : Z_FILTERED) != Z_OK) return;
+        // Prime with the preceding window so matches can reach back across the band seam.
+        if (begin > 0) {
+            const size_t dict = std::min<size_t>(32768, begin);
+            deflateSetDictionary(&zs, filtered.data() + begin - dict, static_cast<uInt>(dict));
+        }
+        band.deflated.resize(deflateBound(&zs, static_cast<uLong>(band.length)) + 64);
+        zs.next_in = filtered.data() + begin;
+        zs.avail_in = static_cast<uInt>(band.length);
+        zs.next_out = band.deflated.data();
+        zs.avail_out = static_cast<uInt>(band.deflated.size());
+        int rc;
+        for (;;) {
+            rc = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+            // Output space used up exactly: the flush may not be complete, so grow and go on.
+            if (rc == Z_STREAM_END || zs.avail_out != 0 || (rc != Z_OK && rc != Z_BUF_ERROR)) break;
+            const size_t used = band.deflated.size();
+            band.deflated.resize(used * 2);
+            zs.next_out = band.deflated.data() + used;
+            zs.avail_out = static_cast<uInt>(band.deflated.size() - used);
+        }
+        band.ok = last ? (rc == Z_STREAM_END) : (rc == Z_OK && zs.avail_in == 0 && zs.avail_out != 0);
+        band.deflated.resize(band.deflated.size() - zs.avail_out);
+        deflateEnd(&zs);
+        band.adler = adler32(1L, filtered.data() + begin, static_cast<uInt>(band.length));
+    };
+
+    // Signature, IHDR, zlib header; then bands as IDAT chunks wave by wave; Adler-32, IEND.
+    std::ofstream f(path, std::ios::binary);
+    if (!f) return false;
+    static const uint8_t kSig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    f.write(reinterpret_cast<const char*>(kSig), 8);
+
+    static const uint8_t kColorType[5] = {0, 0, 4, 2, 6};
+    std::vector<uint8_t> ihdr;
+    put32(ihdr, width);
+    put32(ihdr, height);
+    ihdr.push_back(static_cast<uint8_t>(bitDepth));
+    ihdr.push_back(kColorType[channels]); // gray, gray+alpha, RGB, RGBA
+    ihdr.push_back(0); ihdr.push_back(0); ihdr.push_back(0);
+    if (!writeChunk(f, "IHDR", ihdr.data(), ihdr.size())) return false;
+
+    const uint8_t cmf = 0x78;
+    uint8_t flg = static_cast<uint8_t>((level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6);
+    flg = static_cast<uint8_t>(flg + 31 - ((cmf * 256 + flg) % 31));
+    const uint8_t zhdr[2] = {cmf, flg};
+    if (!writeChunk(f, "IDAT", zhdr, 2)) return false;
+
+    uLong adler = 1;
+    const size_t waveSize = 2 * workers;
+    for (size_t w0 = 0; w0 < nBands; w0 += waveSize) {
+        std::vector<Band> wave(std::min(waveSize, nBands - w0));
+        run(wave.size(), 1, [&](size_t b0, size_t b1) {
+            for (size_t b = b0; b < b1; ++b) encode(w0 + b, wave[b]);
+        });
+        for (const auto& band : wave) {
+            if (!band.ok) return false;
+            adler = adler32_combine(adler, band.adler, static_cast<z_off_t>(band.length));
+            if (!writeChunk(f, "IDAT", band.deflated.data(), band.deflated.size())) return false;
+        }
+    }
+    std::vector<uint8_t> ztail;
+    put32(ztail, static_cast<uint32_t>(adler));
+    if (!writeChunk(f, "IDAT", ztail.data(), ztail.size())) return false;
+    return writeChunk(f, "IEND", nullptr, 0);
+}
+
+bool writePngParallel(const std::filesystem::path& path, const uint8_t* pixels,
+                      uint32_t width, uint32_t height, uint32_t channels,
+                      const PngOptions& opt, ITaskScheduler* sched) {
+    if (!pixels) return false;
+    const size_t rowBytes = static_cast<size_t>(width) * channels;
+    return writePngParallel(path, width, height, channels, 8, [&](uint32_t y0, uint32_t y1, uint8_t* dst) {
+        std::memcpy(dst, pixels + y0 * rowBytes, (y1 - y0) * rowBytes);
+    }, opt, sched);
+}
+
+} // namespace rawproc
+
+#else
+
+namespace rawproc {
+bool writePngParallel(const std::filesystem::path&, uint32_t, uint32_t, uint32_t, int,
+                      const std::function<void(uint32_t, uint32_t, uint8_t*)>&, const PngOptions&, ITaskScheduler*) {
+    return false;
+}
+bool writePngParallel(const std::filesystem::path&, const uint8_t*, uint32_t, uint32_t, uint32_t,
+                      const PngOptions&, ITaskScheduler*) {
+    return false;
+}
+} // namespace rawproc
+
+#endif // RAWPROC_HAVE_ZLIB
@@ -1,12 +1,17 @@
 #include "rawproc/ProcessingPipeline.h"
 
 #include <algorithm>
+#include <chrono>
+#include <climits>
 #include <future>
 #include <unordered_map>
 #include <functional>
+#include <iostream>
 #include <list>
 #include <mutex>
+#include "rawproc/ColorStage.h"
 #include "rawproc/GpuContext.h"
+#include "rawproc/PixelKernels.h"
 
 namespace rawproc {
 
@@ -27,21 +32,260 @@ RgbImageF ProcessingPipeline::apply(const UnifiedRawData& data, RenderMode mode)
     return apply(data, req, mode);
 }
 
-RgbImageF ProcessingPipeline::apply(const UnifiedRawData& data, const RenderRequest& reqIn, RenderMode mode) {
+namespace {
+
+// Copies the part of a rendered tile that falls inside the target.
+void blitTile(const RgbTile& t, const RenderTarget& dst) {
+    PixelFormat format = PixelFormat::F32;
+    uint32_t channels = 3;
+    ConvertParams p;
+    switch (dst.format) {
+    case TargetFormat::RgbF32: break;
+    case TargetFormat::RgbU16: format = PixelFormat::U16; p.scale = 65535.0f; p.alpha = 65535.0f; break;
+    case TargetFormat::RgbaU8:
+    case TargetFormat::BgraU8:
+        format = PixelFormat::U8;
+        channels = 4;
+        p.scale = 255.0f;
+        p.alpha = 255.0f;
+        p.swapRB = dst.format == TargetFormat::BgraU8;
+        break;
+    }
+    const size_t pixelBytes = pixelFormatSize(format) * channels;
+    const int x0 = std::max(t.x, dst.originX), y0 = std::max(t.y, dst.originY);
+    const int x1 = std::min<int>(t.x + static_cast<int>(t.width), dst.originX + static_cast<int>(dst.width));
+    const int y1 = std::min<int>(t.y + static_cast<int>(t.height), dst.originY + static_cast<int>(dst.height));
+    if (x1 <= x0 || y1 <= y0) return;
+    const size_t tStride = static_cast<size_t>(t.width) * 3u;
+    const float* src = t.data->data() + static_cast<size_t>(y0 - t.y) * tStride + static_cast<size_t>(x0 - t.x) * 3u;
+    uint8_t* out = static_cast<uint8_t*>(dst.data) + static_cast<size_t>(y0 - dst.originY) * dst.stride +
+                   static_cast<size_t>(x0 - dst.originX) * pixelBytes;
+    const uint32_t w = static_cast<uint32_t>(x1 - x0), h = static_cast<uint32_t>(y1 - y0);
+    convertPixels(PixelRect::interleaved(src, PixelFormat::F32, 3, w, h, tStride),
+                  PixelRect::interleaved(out, format, channels, w, h, dst.stride / pixelFormatSize(format)), p);
+}
+
+} // namespace
+
+RgbImageF ProcessingPipeline::apply(const UnifiedRawData& data, const RenderRequest& req, RenderMode mode) {
+    int originX = 0, originY = 0;
+    return render(data, req, mode, false, originX, originY);
+}
+
+RgbImageF ProcessingPipeline::applyViewport(const UnifiedRawData& data, const RenderRequest& req, RenderMode mode,
+                                            int& originX, int& originY) {
+    return render(data, req, mode, true, originX, originY);
+}
+
+RgbImageF ProcessingPipeline::render(const UnifiedRawData& data, const RenderRequest& req, RenderMode mode,
+                                     bool cropToTiles, int& originX, int& originY) {
+    RgbImageF rgb;
+    RenderTarget target;
+    int lod = 0;
+    auto onFrame = [&](const FrameInfo& f) {
+        lod = f.lod;
+        const bool crop = cropToTiles && f.x1 > f.x0 && f.y1 > f.y0;
+        rgb.width = crop ? static_cast<uint32_t>(f.x1 - f.x0) : f.width;
+        rgb.height = crop ? static_cast<uint32_t>(f.y1 - f.y0) : f.height;
+        originX = crop ? f.x0 : 0;
+        originY = crop ? f.y0 : 0;
+        const size_t rowFloats = static_cast<size_t>(rgb.width) * 3u;
+        target = {nullptr, rowFloats * sizeof(float), TargetFormat::RgbF32, rgb.width, rgb.height, originX, originY};
+        // Allocation leaves the pages untouched; they are zeroed by the workers of the node that
+        // will later write the corresponding tile rows (first touch). Not needed when the tiles
+        // overwrite every pixel.
+        rgb.data.resize(static_cast<size_t>(rgb.width) * rgb.height * 3u);
+        target.data = rgb.data.data();
+        if (crop ? f.tilesCovered : f.frameCovered) return;
+        parallelRows(rgb.height, [&](uint32_t ry0, uint32_t ry1) {
+            std::fill(rgb.data.begin() + ry0 * rowFloats, rgb.data.begin() + ry1 * rowFloats, 0.0f);
+        });
+    };
+    renderTiles(data, req, mode, onFrame, [&](const RgbTile& t) { if (t.lod == lod) blitTile(t, target); });
+    return rgb;
+}
+
+void ProcessingPipeline::applyInto(const UnifiedRawData& data, const RenderRequest& req, const RenderTarget& target,
+                                   RenderMode mode) {
+    if (!target.data || target.width == 0 || target.height == 0) return;
+    int lod = 0;
+    renderTiles(data, req, mode, [&](const FrameInfo& f) { lod = f.lod; },
+                [&](const RgbTile& t) { if (t.lod == lod) blitTile(t, target); });
+}
+
+RgbTileSet ProcessingPipeline::applyTiles(const UnifiedRawData& data, const RenderRequest& req, RenderMode mode) {
+    RgbTileSet out;
+    std::mutex m;
+    int lod = 0;
+    renderTiles(data, req, mode,
+                [&](const FrameInfo& f) { out.width = f.width; out.height = f.height; lod = f.lod; },
+                [&](const RgbTile& t) {
+                    if (t.lod != lod) return;
+                    std::lock_guard<std::mutex> lk(m);
+                    out.tiles.push_back(t);
+                });
+    // Deterministic order for consumers (row-major by tile origin)
+    std::sort(out.tiles.begin(), out.tiles.end(), [](const RgbTile& a, const RgbTile& b) {
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    });
+    return out;
+}
+
+std::vector<RgbTile> ProcessingPipeline::applyTileList(const UnifiedRawData& data, const RenderRequest& req, RenderMode mode) {
+    std::vector<RgbTile> out;
+    std::mutex m;
+    renderTiles(data, req, mode, [](const FrameInfo&) {},
+                [&](const RgbTile& t) { std::lock_guard<std::mutex> lk(m); out.push_back(t); });
+    std::sort(out.begin(), out.end(), [](const RgbTile& a, const RgbTile& b) {
+        return a.lod != b.lod ? a.lod < b.lod : a.y != b.y ? a.y < b.y : a.x < b.x;
+    });
+    return out;
+}
+
+int ProcessingPipeline::lodFrameSize(uint32_t baseWidth, uint32_t baseHeight, int lod, uint32_t& width, uint32_t& height) {
+    // Mirrors acquireMips: each level halves the previous one, and the chain ends at the first
+    // level that is 1 pixel thin.
+    uint32_t w = baseWidth, h = baseHeight;
+    int l = 0;
+    for (; l < lod && w > 1 && h > 1; ++l) {
+        w /= 2;
+        h /= 2;
+    }
+    width = w;
+    height = h;
+    return l;
+}
+
+TileTuner::Inputs ProcessingPipeline::tileInputs(const UnifiedRawData& data, int lod, RenderMode mode) const {
+    const auto plan = executionPlan(data, mode);
+    TileTuner::Inputs in;
+    lodFrameSize(data.raw.width, data.raw.height, lod, in.frameWidth, in.frameHeight);
+    // Same apron as the render path; each raw stage is assumed to keep one scratch copy of the
+    // 16-bit tile, and the RGB tile holds three floats per pixel.
+    in.apron = plan->rawApron;
+    in.bytesPerPixel = plan->bytesPerPixel;
+    in.workers = std::max<size_t>(1, pool_->size());
+    return in;
+}
+
+std::shared_ptr<const ExecutionPlan> ProcessingPipeline::executionPlan(const UnifiedRawData& data, RenderMode mode) const {
+    const size_t key = ExecutionPlan::stateKey(pm_, data.history, mode);
+    std::lock_guard<std::mutex> lk(planMutex_);
+    auto& plan = plans_[mode == RenderMode::FullColor ? 1 : 0];
+    if (!plan || plan->key != key) plan = ExecutionPlan::build(pm_, data.history, mode);
+    return plan;
+}
+
+int ProcessingPipeline::resolveTileSize(const UnifiedRawData& data, const RenderRequest& req, RenderMode mode) {
+    if (req.tileSize > 0) return req.tileSize;
+    return tuner_.tileSize(tileInputs(data, req.lod, mode));
+}
+
+int ProcessingPipeline::calibrateTileSize(const UnifiedRawData& data, RenderMode mode, int lod) {
+    const TileTuner::Inputs in = tileInputs(data, lod, mode);
+    const int model = tuner_.modelTileSize(in);
+    ProcessingPipeline bench(pm_);
+    bench.setNumaAware(numaAware_);
+    int best = model;
+    double bestMs = 0.0;
+    int last = 0;
+    for (int candidate : {model / 2, model * 3 / 4, model, model * 3 / 2, model * 2}) {
+        const int size = TileTuner::roundTileSize(candidate);
+        if (size == last) continue;
+        last = size;
+        RenderRequest req;
+        req.lod = lod;
+        req.tileSize = size;
+        bench.apply(data, req, mode); // builds the mips; later runs only time the tiles
+        double ms = 0.0;
+        for (int rep = 0; rep < 2; ++rep) {
+            bench.clearCache();
+            const auto t0 = std::chrono::steady_clock::now();
+            bench.apply(data, req, mode);
+            const double t = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            ms = rep ? std::min(ms, t) : t;
+        }
+        if (bestMs == 0.0 || ms < bestMs) { bestMs = ms; best = size; }
+    }
+    tuner_.setCalibrated(in, best);
+    return tuner_.tileSize(in); // as stored, i.e. within the load-balance cap
+}
+
+std::vector<TileCoord> ProcessingPipeline::tilesForViewport(uint32_t baseWidth, uint32_t baseHeight, int x, int y,
+                                                            int width, int height, int lod, int tileSize) {
+    std::vector<TileCoord> tiles;
+    if (tileSize <= 0) return tiles;
+    uint32_t lw = 0, lh = 0;
+    lod = lodFrameSize(baseWidth, baseHeight, lod, lw, lh);
+    // Clip at LOD 0, then map outward so every mip pixel touching the viewport is included.
+    const int64_t x0 = std::max<int64_t>(0, x), y0 = std::max<int64_t>(0, y);
+    const int64_t x1 = std::min<int64_t>(baseWidth, int64_t(x) + width), y1 = std::min<int64_t>(baseHeight, int64_t(y) + height);
+    if (x1 <= x0 || y1 <= y0) return tiles;
+    const int64_t scale = int64_t(1) << lod;
+    const int64_t lx0 = x0 / scale, ly0 = y0 / scale;
+    const int64_t lx1 = std::min<int64_t>(lw, (x1 + scale - 1) / scale), ly1 = std::min<int64_t>(lh, (y1 + scale - 1) / scale);
+    if (lx1 <= lx0 || ly1 <= ly0) return tiles;
+    const int tx0 = static_cast<int>(lx0 / tileSize), tx1 = static_cast<int>((lx1 - 1) / tileSize);
+    const int ty0 = static_cast<int>(ly0 / tileSize), ty1 = static_cast<int>((ly1 - 1) / tileSize);
+    tiles.reserve(static_cast<size_t>(tx1 - tx0 + 1) * (ty1 - ty0 + 1));
+    for (int ty = ty0; ty <= ty1; ++ty)
+        for (int tx = tx0; tx <= tx1; ++tx) tiles.push_back({tx, ty, lod});
+    return tiles;
+}
+
+void ProcessingPipeline::renderTiles(const UnifiedRawData& data, const RenderRequest& reqIn, RenderMode mode,
+                                     const std::function<void(const FrameInfo&)>& onFrame,
+                                     const std::function<void(const RgbTile&)>& onTile) {
     RenderRequest req = reqIn;
-    if (useGpu_ && !gpu_) {
-        gpu_ = std::make_unique<GpuContext>();
-        gpu_->setDebugMode(static_cast<GpuContext::DebugMode>(gpuDebugMode_));
-        gpu_->setSyntheticInput(gpuSynth_);
-    }
-    // Build or reuse RAW mips for requested LOD
-    ensureRawMips(data, req.lod);
-    const RawImage& fullRaw = (req.lod >= 0 && req.lod < static_cast<int>(rawMips_.size())) ? rawMips_[req.lod] : data.raw;
-    if (req.outWidth == 0 || req.outHeight == 0) {
-        req.outWidth = static_cast<int>(fullRaw.width);
-        req.outHeight = static_cast<int>(fullRaw.height);
-    }
-    if (req.tileSize <= 0) req.tileSize = 256;
+    req.tileSize = resolveTileSize(data, req, mode);
+    const std::shared_ptr<const ExecutionPlan> planRef = executionPlan(data, mode);
+    const ExecutionPlan& plan = *planRef;
+    const auto hashes = computeHashes(data, plan, req.tileSize);
+    const size_t pipelineHash = combineHashes(hashes);
+    // Local edits reported since the last render. The full-color chain has the widest margins
+    // (every step plus the demosaic), and its tiles are dropped along with the gray ones.
+    std::shared_ptr<const ExecutionPlan> colorPlan;
+    for (const auto& step : plan.steps) {
+        PixelRegion dirty;
+        if (!step.plugin->takeDirtyRegion(dirty)) continue;
+        if (!colorPlan) colorPlan = mode == RenderMode::FullColor ? planRef : executionPlan(data, RenderMode::FullColor);
+        int apron = colorPlan->rawApron;
+        for (const auto& cs : colorPlan->steps) if (cs.index == step.index) apron = cs.radius + cs.margin;
+        invalidateTiles(hashes.source, dirty, apron);
+        // Analyses of this step or later ones may have seen the edited pixels.
+        bool staleAnalysis = false;
+        for (const auto& as : plan.steps) staleAnalysis |= as.analysisLod >= 0 && as.index >= step.index;
+        if (staleAnalysis) {
+            std::lock_guard<std::mutex> lk(analysisMutex_);
+            analysisCache_.clear();
+        }
+    }
+
+    // Geometry follows from the base size alone, so the request can be resolved before any mip,
+    // normalization or analysis work. Every tile renders at its own LOD (clamped to the mip
+    // chain) on that level's grid; the frame is the one at req.lod, optionally clipped to
+    // outWidth x outHeight.
+    uint32_t frameW = 0, frameH = 0;
+    const int maxLod = lodFrameSize(data.raw.width, data.raw.height, INT_MAX, frameW, frameH);
+    req.lod = std::min(std::max(req.lod, 0), maxLod);
+    struct Level {
+        uint32_t width = 0, height = 0; // mip size
+        int clipW = 0, clipH = 0;       // tiles are clipped to this
+    };
+    std::vector<Level> levels(static_cast<size_t>(maxLod) + 1);
+    for (int l = 0; l <= maxLod; ++l) {
+        Level& lv = levels[l];
+        lodFrameSize(data.raw.width, data.raw.height, l, lv.width, lv.height);
+        lv.clipW = static_cast<int>(lv.width);
+        lv.clipH = static_cast<int>(lv.height);
+    }
+    Level& frameLevel = levels[req.lod];
+    frameW = frameLevel.width;
+    frameH = frameLevel.height;
+    if (req.outWidth > 0) frameLevel.clipW = std::min(frameLevel.clipW, req.outWidth);
+    if (req.outHeight > 0) frameLevel.clipH = std::min(frameLevel.clipH, req.outHeight);
+    req.outWidth = frameLevel.clipW;
+    req.outHeight = frameLevel.clipH;
     if (req.tiles.empty()) {
         const int tilesX = (req.outWidth + req.tileSize - 1) / req.tileSize;
         const int tilesY = (req.outHeight + req.tileSize - 1) / req.tileSize;
@@ -49,285 +293,582 @@ RgbImageF ProcessingPipeline::apply(const UnifiedRawData& data, const RenderRequ
         for (int ty = 0; ty < tilesY; ++ty)
             for (int tx = 0; tx < tilesX; ++tx) req.tiles.push_back({tx, ty, req.lod});
     }
+    int tileLod = 0; // finest level the tiles need
+    for (auto& tc : req.tiles) {
+        tc.lod = std::min(std::max(tc.lod, 0), maxLod);
+        tileLod = std::max(tileLod, tc.lod);
+    }
+    // Inner rect of a tile on its level; false if it lies outside.
+    auto tileRect = [&](const TileCoord& tc, int& x, int& y, int& w, int& h) {
+        const Level& lv = levels[tc.lod];
+        x = tc.x * req.tileSize;
+        y = tc.y * req.tileSize;
+        w = std::min(req.tileSize, lv.clipW - x);
+        h = std::min(req.tileSize, lv.clipH - y);
+        return tc.x >= 0 && tc.y >= 0 && w > 0 && h > 0;
+    };
+    const FrameInfo frame = frameInfo(req, frameW, frameH);
+
+    // Fast path: every tile is cached, so only hand out the cached buffers.
+    {
+        std::vector<RgbTile> hits;
+        std::vector<size_t> keys;
+        hits.reserve(req.tiles.size());
+        keys.reserve(req.tiles.size());
+        for (const auto& tc : req.tiles) {
+            RgbTile t;
+            int tw = 0, th = 0;
+            if (!tileRect(tc, t.x, t.y, tw, th)) continue;
+            t.width = static_cast<uint32_t>(tw);
+            t.height = static_cast<uint32_t>(th);
+            t.lod = tc.lod;
+            hits.push_back(t);
+            keys.push_back(tileKey(pipelineHash, tc));
+        }
+        if (cacheLookupAll(keys, hits)) {
+            onFrame(frame);
+            size_t pixels = 0;
+            for (const auto& t : hits) pixels += static_cast<size_t>(t.width) * t.height;
+            if (hits.size() == 1 || pixels < (size_t(1) << 20)) {
+                // Small repaints: task hand-off would cost more than the copies.
+                for (const auto& t : hits) onTile(t);
+                return;
+            }
+            // Large blits run where the tile's output rows live, as on the render path.
+            std::vector<std::future<void>> futs;
+            futs.reserve(hits.size());
+            for (const auto& t : hits) {
+                const size_t node = pool_->nodeForRow(static_cast<size_t>(std::max(0, t.y)), levels[t.lod].height);
+                futs.push_back(pool_->enqueueOnNode(node, [&onTile, &t]{ onTile(t); }));
+            }
+            for (auto& f : futs) f.get();
+            return;
+        }
+    }
 
-    // Determine PRE_DEMOSAIC max radius to compute apron
-    size_t preRadius = 0;
-    for (const auto& step : data.history) {
-        auto inst = pm_.getInstance(step.instanceId);
-        if (!inst) continue;
-        if (inst->getProcessingStage() == ProcessingStage::PRE_DEMOSAIC) {
-            preRadius = std::max(preRadius, inst->kernelRadiusPx());
+    // Global analysis for two-phase plugins: cached results are reused; on a miss the analysis
+    // LOD mip has to be available as well.
+    Analyses analyses;
+    std::vector<size_t> analysisKeys;
+    const int analysisLod = lookupAnalyses(plan, hashes, analyses, analysisKeys);
+
+    // Build or reuse RAW mips for requested LOD (mosaic-preserving when they will be demosaiced)
+    const bool fullColor = mode == RenderMode::FullColor;
+    const auto mips = acquireMips(data, hashes.content, std::max({tileLod, req.lod, analysisLod}), fullColor && data.meta.bayer);
+    auto levelRaw = [&](int lod) -> const RawImage& { return mips->level(data.raw, lod); };
+    GpuContext* gpu = nullptr;
+    if (useGpu_ && !fullColor) {
+        std::lock_guard<std::mutex> lk(gpuMutex_);
+        if (!gpu_) {
+            gpu_ = std::make_unique<GpuContext>();
+            gpu_->setDebugMode(static_cast<GpuContext::DebugMode>(gpuDebugMode_));
+            gpu_->setSyntheticInput(gpuSynth_);
         }
+        if (gpu_->isAvailable()) gpu = gpu_.get();
     }
-    // Scale radius for LOD (approximate): radius at LOD = max(0, floor(radius / 2^lod))
-    int scaledRadius = static_cast<int>(preRadius);
-    for (int i = 0; i < req.lod && scaledRadius > 0; ++i) scaledRadius >>= 1;
-    const int apron = scaledRadius;
 
-    // Prepare output image
-    RgbImageF rgb;
-    rgb.width = fullRaw.width;
-    rgb.height = fullRaw.height;
-    rgb.data.resize(static_cast<size_t>(rgb.width) * rgb.height * 3u, 0.0f);
+    // Prepare output frame
+    onFrame(frame);
 
-    // Normalization params (grayscale)
+    // Normalization params (grayscale); without usable levels they come from the frame's mip and
+    // apply to every LOD of the request.
     float blackN = data.meta.black_level;
     float whiteN = data.meta.white_level;
     if (!(whiteN > blackN + 1.0f)) {
+        const RawImage& fullRaw = levelRaw(req.lod);
         uint16_t minv = 0xFFFF, maxv = 0;
-        for (auto v : fullRaw.data) { if (v < minv) minv = v; if (v > maxv) maxv = v; }
+        for (uint32_t y = 0; y < fullRaw.height; ++y) {
+            const uint16_t* r = fullRaw.row(y);
+            for (uint32_t x = 0; x < fullRaw.width; ++x) { minv = std::min(minv, r[x]); maxv = std::max(maxv, r[x]); }
+        }
         blackN = static_cast<float>(minv);
         whiteN = static_cast<float>(maxv);
     }
     const float denom = (whiteN > blackN + 1.0f) ? (whiteN - blackN) : 1.0f;
     const float invNorm = 1.0f / denom;
 
+    if (analysisLod >= 0) runGlobalAnalysis(data, plan, *mips, analysisLod, blackN, invNorm, analysisKeys, analyses);
+    const LinearColorTransform color = LinearColorTransform::fromMeta(data.meta);
+    ConvertParams grayParams;
+    grayParams.bias = -blackN;
+    grayParams.scale = invNorm;
+    grayParams.lo = 0.0f;
+    grayParams.hi = 1.0f;
+
     // Process tiles in parallel with simple caching
-    const auto hashes = computeHashes(data, mode, req.tileSize, req.lod);
-    const size_t pipelineHash = combineHashes(hashes);
+    // Plugins share the tile workers for any internal parallelism.
+    // Plugin contexts per LOD (indexed [lod][history index]).
+    std::vector<std::vector<ProcessContext>> stepCtx(levels.size());
+    for (const auto& tc : req.tiles) {
+        auto& ctx = stepCtx[tc.lod];
+        if (!ctx.empty() || plan.steps.empty()) continue;
+        ProcessContext pctx;
+        pctx.scheduler = pool_.get();
+        pctx.lod = tc.lod;
+        ctx.assign(plan.historySize, pctx);
+        for (size_t i = 0; i < analyses.size(); ++i) ctx[i].analysis = analyses[i].get();
+    }
     std::vector<std::future<void>> futs;
     futs.reserve(req.tiles.size());
     for (const auto& tc : req.tiles) {
-        futs.push_back(pool_.enqueue([&, tc]{
-            // Compute inner tile rect
-            const int x0 = tc.x * req.tileSize;
-            const int y0 = tc.y * req.tileSize;
-            const int tw = std::min(req.tileSize, req.outWidth - x0);
-            const int th = std::min(req.tileSize, req.outHeight - y0);
-            if (tw <= 0 || th <= 0) return;
+        const size_t node = pool_->nodeForRow(static_cast<size_t>(std::max(0, tc.y * req.tileSize)), levels[tc.lod].height);
+        futs.push_back(pool_->enqueueOnNode(node, [&, tc]{
+            // Compute inner tile rect on the tile's level
+            int x0 = 0, y0 = 0, tw = 0, th = 0;
+            if (!tileRect(tc, x0, y0, tw, th)) return;
+            const Level& lv = levels[tc.lod];
+            const RawImage& fullRaw = levelRaw(tc.lod);
+            const int apron = plan.rawApron;
+            const std::vector<ProcessContext>& ctx = stepCtx[tc.lod];
+
+            RgbTile tile;
+            tile.x = x0; tile.y = y0;
+            tile.width = static_cast<uint32_t>(tw); tile.height = static_cast<uint32_t>(th);
+            tile.lod = tc.lod;
 
             // Cache key
-            size_t key = hashCombine(pipelineHash, static_cast<size_t>((tc.lod << 28) ^ (tc.y << 14) ^ tc.x));
+            const size_t key = tileKey(pipelineHash, tc);
             // Check cache
             if (auto cached = cacheLookup(key, tw, th)) {
-                // Blit cached tile to output
-                const auto& buf = *cached;
-                for (int yy = 0; yy < th; ++yy) {
-                    for (int xx = 0; xx < tw; ++xx) {
-                        size_t si = (static_cast<size_t>(yy) * tw + xx) * 3u;
-                        size_t di = (static_cast<size_t>(y0 + yy) * rgb.width + (x0 + xx)) * 3u;
-                        rgb.data[di + 0] = buf[si + 0];
-                        rgb.data[di + 1] = buf[si + 1];
-                        rgb.data[di + 2] = buf[si + 2];
-                    }
-                }
+                tile.data = std::move(cached);
+                onTile(tile);
                 return;
             }
 
             // Compute source rect with apron, clamped to image bounds
             const int sx0 = std::max(0, x0 - apron);
             const int sy0 = std::max(0, y0 - apron);
-            const int sx1 = std::min<int>(req.outWidth, x0 + tw + apron);
-            const int sy1 = std::min<int>(req.outHeight, y0 + th + apron);
+            const int sx1 = std::min<int>(static_cast<int>(lv.width), x0 + tw + apron);
+            const int sy1 = std::min<int>(static_cast<int>(lv.height), y0 + th + apron);
             const int sw = sx1 - sx0;
             const int sh = sy1 - sy0;
 
-            // Extract raw tile with apron (from selected LOD)
+            // Raw tile with apron (from selected LOD): a view borrowing the level's rows, copied
+            // on the first step that writes raw pixels. fullRaw outlives the tile tasks.
             RawImage tileRaw;
             tileRaw.width = sw;
             tileRaw.height = sh;
-            tileRaw.data.resize(static_cast<size_t>(sw) * sh);
-            for (int y = 0; y < sh; ++y) {
-                const uint16_t* src = &fullRaw.data[(sy0 + y) * fullRaw.width + sx0];
-                uint16_t* dst = &tileRaw.data[y * sw];
-                std::copy(src, src + sw, dst);
-            }
+            tileRaw.view = fullRaw.row(static_cast<uint32_t>(sy0)) + sx0;
+            tileRaw.stride = fullRaw.rowStride();
+
+            // Each step only has to produce the inner tile grown by the margin the later stages
+            // read (clipped to the buffer at (bx, by), bw x bh).
+            auto stepCtxFor = [&](const ExecutionPlan::Step& step, int bx, int by, int bw, int bh) {
+                ProcessContext c = ctx[step.index];
+                c.originX = bx;
+                c.originY = by;
+                const int m = step.margin;
+                const int rx0 = std::max(bx, x0 - m), ry0 = std::max(by, y0 - m);
+                c.region.x = rx0 - bx;
+                c.region.y = ry0 - by;
+                c.region.width = std::min(bx + bw, x0 + tw + m) - rx0;
+                c.region.height = std::min(by + bh, y0 + th + m) - ry0;
+                return c;
+            };
 
             // Apply PRE_DEMOSAIC plugins to tileRaw (with apron)
-            for (const auto& step : data.history) {
-                auto inst = pm_.getInstance(step.instanceId);
-                if (!inst) continue;
-                if (inst->getProcessingStage() == ProcessingStage::PRE_DEMOSAIC) {
-                    inst->process_raw(tileRaw);
-                }
+            for (size_t i : plan.stage(ProcessingStage::PRE_DEMOSAIC)) {
+                const ExecutionPlan::Step& step = plan.steps[i];
+                if (step.writesRaw) tileRaw.makeCompact();
+                step.plugin->process_raw(tileRaw, stepCtxFor(step, sx0, sy0, sw, sh));
             }
 
-            // GPU/CPU processing of inner region
-            auto cpuProcess = [&](){
-                // grayscale into rgb main buffer
-                for (int yy = 0; yy < th; ++yy) {
-                    const int srcY = yy + (y0 - sy0);
-                    const int dstY = y0 + yy;
-                    for (int xx = 0; xx < tw; ++xx) {
-                        const int srcX = xx + (x0 - sx0);
-                        const uint16_t v = tileRaw.data[srcY * sw + srcX];
-                        float g = (static_cast<float>(v) - blackN) * invNorm;
-                        if (g < 0.0f) g = 0.0f; if (g > 1.0f) g = 1.0f;
-                        const size_t di = (static_cast<size_t>(dstY) * rgb.width + (x0 + xx)) * 3u;
-                        rgb.data[di + 0] = g; rgb.data[di + 1] = g; rgb.data[di + 2] = g;
-                    }
-                }
-                // build tileRgb view
-                RgbImageF tileRgb; tileRgb.width = tw; tileRgb.height = th; tileRgb.data.resize(static_cast<size_t>(tw) * th * 3u);
-                for (int yy = 0; yy < th; ++yy) {
-                    for (int xx = 0; xx < tw; ++xx) {
-                        size_t si = (static_cast<size_t>(y0 + yy) * rgb.width + (x0 + xx)) * 3u;
-                        size_t di = (static_cast<size_t>(yy) * tw + xx) * 3u;
-                        tileRgb.data[di + 0] = rgb.data[si + 0];
-                        tileRgb.data[di + 1] = rgb.data[si + 1];
-                        tileRgb.data[di + 2] = rgb.data[si + 2];
-                    }
-                }
-                for (const auto& step : data.history) {
-                    auto inst = pm_.getInstance(step.instanceId);
-                    if (!inst) continue;
-                    if (inst->getProcessingStage() == ProcessingStage::FINALIZE) inst->process_rgb(tileRgb);
-                }
-                // write back
-                for (int yy = 0; yy < th; ++yy) {
-                    for (int xx = 0; xx < tw; ++xx) {
-                        size_t si = (static_cast<size_t>(yy) * tw + xx) * 3u;
-                        size_t di = (static_cast<size_t>(y0 + yy) * rgb.width + (x0 + xx)) * 3u;
-                        rgb.data[di + 0] = tileRgb.data[si + 0];
-                        rgb.data[di + 1] = tileRgb.data[si + 1];
-                        rgb.data[di + 2] = tileRgb.data[si + 2];
-                    }
-                }
-                // copy buffer for caching
-                auto sp = std::make_shared<std::vector<float>>(static_cast<size_t>(tw) * th * 3u);
-                for (int yy = 0; yy < th; ++yy) {
-                    for (int xx = 0; xx < tw; ++xx) {
-                        size_t si = (static_cast<size_t>(y0 + yy) * rgb.width + (x0 + xx)) * 3u;
-                        size_t di = (static_cast<size_t>(yy) * tw + xx) * 3u;
-                        (*sp)[di+0] = rgb.data[si+0];
-                        (*sp)[di+1] = rgb.data[si+1];
-                        (*sp)[di+2] = rgb.data[si+2];
-                    }
+            // GPU/CPU processing into the inner tile plus the apron of the RGB stages
+            const int rx0 = std::max(0, x0 - plan.rgbApron), ry0 = std::max(0, y0 - plan.rgbApron);
+            const int rw = std::min<int>(static_cast<int>(lv.width), x0 + tw + plan.rgbApron) - rx0;
+            const int rh = std::min<int>(static_cast<int>(lv.height), y0 + th + plan.rgbApron) - ry0;
+            RgbImageF tileRgb;
+            tileRgb.width = rw; tileRgb.height = rh;
+            tileRgb.data.resize(static_cast<size_t>(rw) * rh * 3u);
+            bool gpuDone = false;
+            auto runRgbStage = [&](ProcessingStage stage) {
+                for (size_t i : plan.stage(stage)) {
+                    const ExecutionPlan::Step& step = plan.steps[i];
+                    step.plugin->process_rgb(tileRgb, stepCtxFor(step, rx0, ry0, rw, rh));
                 }
-                return sp;
             };
-
-            std::shared_ptr<std::vector<float>> buf;
-            bool gpuDone = false;
-            if (useGpu_ && gpu_ && gpu_->isAvailable()) {
-                gpuDone = gpu_->processGrayAndGamma(tileRaw, x0, y0, tw, th, sx0, sy0, sw, sh, blackN, invNorm, rgb, 2.2f);
+            if (fullColor) {
+                // Demosaic, then the fused WB/matrix/clip pass and the linear-light plugins
+                demosaicBilinear(tileRaw, sx0, sy0, data.meta, blackN, invNorm, rx0 - sx0, ry0 - sy0, rw, rh, tileRgb.data.data());
+                applyLinearColor(tileRgb.data.data(), static_cast<size_t>(rw) * rh, color);
+                runRgbStage(ProcessingStage::POST_DEMOSAIC_LINEAR);
+            } else if (gpu && plan.rgbApron == 0) {
+                // The GPU path writes the inner tile only, so it is used when no RGB stage needs apron.
+                std::lock_guard<std::mutex> lk(gpuMutex_);
+                gpuDone = gpu->processGrayAndGamma(tileRaw, 0, 0, tw, th, sx0 - x0, sy0 - y0, sw, sh, blackN, invNorm, tileRgb, 2.2f);
+            }
+            if (!gpuDone && !fullColor) {
+                // grayscale
+                convertPixels(PixelRect::interleaved(tileRaw.row(static_cast<uint32_t>(ry0 - sy0)) + (rx0 - sx0), PixelFormat::U16, 1, rw, rh, tileRaw.rowStride()),
+                              PixelRect::interleaved(tileRgb.data.data(), PixelFormat::F32, 3, rw, rh, static_cast<size_t>(rw) * 3u),
+                              grayParams);
             }
-            if (!gpuDone) {
-                buf = cpuProcess();
+            if (!gpuDone) runRgbStage(ProcessingStage::FINALIZE);
+            std::shared_ptr<PixelBuffer<float>> buf;
+            if (rw == tw && rh == th) {
+                buf = std::make_shared<PixelBuffer<float>>(std::move(tileRgb.data)); // no apron: cache as is
             } else {
-                // Build cache buffer from rgb (inner region)
-                buf = std::make_shared<std::vector<float>>(static_cast<size_t>(tw) * th * 3u);
-                for (int yy = 0; yy < th; ++yy) {
-                    for (int xx = 0; xx < tw; ++xx) {
-                        size_t si = (static_cast<size_t>(y0 + yy) * rgb.width + (x0 + xx)) * 3u;
-                        size_t di = (static_cast<size_t>(yy) * tw + xx) * 3u;
-                        (*buf)[di+0] = rgb.data[si+0];
-                        (*buf)[di+1] = rgb.data[si+1];
-                        (*buf)[di+2] = rgb.data[si+2];
-                    }
-                }
+                // Drop the RGB apron
+                buf = std::make_shared<PixelBuffer<float>>(static_cast<size_t>(tw) * th * 3u);
+                const float* src = tileRgb.data.data() + (static_cast<size_t>(y0 - ry0) * rw + (x0 - rx0)) * 3u;
+                convertPixels(PixelRect::interleaved(src, PixelFormat::F32, 3, tw, th, static_cast<size_t>(rw) * 3u),
+                              PixelRect::interleaved(buf->data(), PixelFormat::F32, 3, tw, th, static_cast<size_t>(tw) * 3u));
             }
-            cacheInsert(key, tw, th, buf);
+            TileTag tag;
+            tag.source = hashes.source;
+            tag.lod = tc.lod;
+            tag.x = x0;
+            tag.y = y0;
+            cacheInsert(key, tag, tw, th, buf);
+            tile.data = std::move(buf);
+            onTile(tile);
         }));
     }
 
     for (auto& f : futs) f.get();
-
-    return rgb;
 }
 
 void ProcessingPipeline::clearCache() {
-    std::lock_guard<std::mutex> lk(cacheMutex_);
-    tileCache_.clear();
-    lru_.clear();
-    cacheBytes_ = 0;
+    {
+        std::lock_guard<std::mutex> lk(cacheMutex_);
+        tileCache_.clear();
+        lru_.clear();
+        cacheBytes_ = 0;
+    }
+    std::lock_guard<std::mutex> lk(analysisMutex_);
+    analysisCache_.clear();
+}
+
+int ProcessingPipeline::lookupAnalyses(const ExecutionPlan& plan, const PipelineHashes& h, Analyses& out,
+                                       std::vector<size_t>& keys) {
+    std::hash<int> Hi;
+    out.assign(plan.historySize, nullptr);
+    keys.assign(plan.historySize, 0);
+    // One analysis LOD for the whole chain (the coarsest requested), independent of the render
+    // LOD so that every zoom level sees the same statistics.
+    const int lod = plan.analysisLod;
+    if (lod < 0) return -1;
+
+    bool missing = false;
+    std::lock_guard<std::mutex> lk(analysisMutex_);
+    for (const auto& step : plan.steps) {
+        if (step.analysisLod < 0) continue;
+        // The render mode changes what the RGB stages see, so it is part of the key.
+        const size_t key = hashCombine(hashCombine(hashCombine(h.source, step.prefixHash), Hi(lod)), Hi(static_cast<int>(plan.mode)));
+        keys[step.index] = key;
+        auto it = analysisCache_.find(key);
+        if (it != analysisCache_.end()) out[step.index] = it->second;
+        else missing = true;
+    }
+    return missing ? lod : -1;
+}
+
+void ProcessingPipeline::runGlobalAnalysis(const UnifiedRawData& data, const ExecutionPlan& plan, const MipChain& mips, int lod,
+                                           float blackN, float invNorm, const std::vector<size_t>& keys, Analyses& out) {
+    // Only the prefix of the chain that feeds the last missing analysis has to run.
+    size_t last = 0;
+    for (size_t i = 0; i < keys.size(); ++i) if (keys[i] && !out[i]) last = i + 1;
+    if (last == 0) return;
+
+    const int mip = std::min<int>(lod, static_cast<int>(mips.levels.size()));
+    // A view of the level, like the tile path: copied only before a raw step writes it.
+    const RawImage& src = mips.level(data.raw, mip);
+    RawImage raw;
+    raw.width = src.width;
+    raw.height = src.height;
+    raw.view = src.row(0);
+    raw.stride = src.rowStride();
+    ProcessContext ctx;
+    ctx.scheduler = pool_.get();
+    ctx.lod = mip;
+
+    auto analyze = [&](size_t i, auto&& fn) {
+        if (!keys[i] || out[i]) return;
+        out[i] = fn();
+        std::lock_guard<std::mutex> lk(analysisMutex_);
+        // Small bounded cache: results are tiny, but stale parameter states accumulate.
+        if (analysisCache_.size() >= 256) analysisCache_.clear();
+        analysisCache_[keys[i]] = out[i];
+    };
+
+    // Same stage order as the tile path: PRE_DEMOSAIC on raw, normalize (or demosaic and color
+    // convert, then POST_DEMOSAIC_LINEAR), FINALIZE on RGB.
+    for (size_t si : plan.stage(ProcessingStage::PRE_DEMOSAIC)) {
+        const ExecutionPlan::Step& step = plan.steps[si];
+        if (step.index >= last) break;
+        ctx.analysis = nullptr;
+        analyze(step.index, [&]{ return step.plugin->analyze_raw(raw, ctx); });
+        ctx.analysis = out[step.index].get();
+        if (step.writesRaw) raw.makeCompact();
+        step.plugin->process_raw(raw, ctx);
+    }
+    RgbImageF rgb;
+    rgb.width = raw.width;
+    rgb.height = raw.height;
+    rgb.data.resize(static_cast<size_t>(raw.width) * raw.height * 3u);
+    if (plan.mode == RenderMode::FullColor) {
+        demosaicBilinear(raw, 0, 0, data.meta, blackN, invNorm, 0, 0, static_cast<int>(raw.width),
+                         static_cast<int>(raw.height), rgb.data.data());
+        applyLinearColor(rgb.data.data(), static_cast<size_t>(raw.width) * raw.height, LinearColorTransform::fromMeta(data.meta));
+    } else {
+        ConvertParams gray;
+        gray.bias = -blackN;
+        gray.scale = invNorm;
+        gray.lo = 0.0f;
+        gray.hi = 1.0f;
+        convertPixels(PixelRect::interleaved(raw.row(0), PixelFormat::U16, 1, raw.width, raw.height, raw.rowStride()),
+                      PixelRect::interleaved(rgb.data.data(), PixelFormat::F32, 3, raw.width, raw.height, raw.width * 3u), gray);
+    }
+    for (ProcessingStage stage : {ProcessingStage::POST_DEMOSAIC_LINEAR, ProcessingStage::FINALIZE}) {
+        for (size_t si : plan.stage(stage)) {
+            const ExecutionPlan::Step& step = plan.steps[si];
+            if (step.index >= last) break;
+            ctx.analysis = nullptr;
+            analyze(step.index, [&]{ return step.plugin->analyze_rgb(rgb, ctx); });
+            ctx.analysis = out[step.index].get();
+            step.plugin->process_rgb(rgb, ctx);
+        }
+    }
 }
 
 size_t ProcessingPipeline::hashCombine(size_t a, size_t b) {
-    // 64-bit mix
-    a ^= b + 0x9e3779b97f4a7c15ULL + (a<<6) + (a>>2);
-    return a;
+    return hashMix(a, b);
 }
 
 size_t ProcessingPipeline::computePipelineHash(const UnifiedRawData& data, RenderMode mode, int tileSize, int lod) {
     // Deprecated: kept for ABI compatibility; use computeHashes+combineHashes
-    auto ph = computeHashes(data, mode, tileSize, lod);
+    // The LOD is part of each tile key instead.
+    (void)lod;
+    auto ph = computeHashes(data, *executionPlan(data, mode), tileSize);
     return combineHashes(ph);
 }
 
-void ProcessingPipeline::ensureRawMips(const UnifiedRawData& data, int lodNeeded) {
-    if (lodNeeded <= 0) { rawMips_.clear(); return; }
-    // Rebuild if base image changed
-    if (rawMips_.empty() || mipsBaseW_ != data.raw.width || mipsBaseH_ != data.raw.height) {
-        rawMips_.clear();
-        rawMips_.push_back(data.raw);
-        mipsBaseW_ = data.raw.width;
-        mipsBaseH_ = data.raw.height;
+ProcessingPipeline::FrameInfo ProcessingPipeline::frameInfo(const RenderRequest& req, uint32_t w, uint32_t h) {
+    FrameInfo f;
+    f.width = w;
+    f.height = h;
+    f.lod = req.lod;
+    if (w == 0 || h == 0 || req.tileSize <= 0) return f;
+    // Tiles are clipped to the output size and to the frame; each grid cell counts once. Tiles
+    // at other LODs are not part of the frame.
+    const int clipW = std::min<int>(static_cast<int>(w), req.outWidth), clipH = std::min<int>(static_cast<int>(h), req.outHeight);
+    const int ts = req.tileSize;
+    const size_t gx = static_cast<size_t>((clipW + ts - 1) / ts), gy = static_cast<size_t>((clipH + ts - 1) / ts);
+    std::vector<char> seen(gx * gy, 0);
+    size_t n = 0;
+    int cx0 = INT_MAX, cy0 = INT_MAX, cx1 = -1, cy1 = -1; // cell range
+    for (const auto& tc : req.tiles) {
+        if (tc.lod != req.lod || tc.x < 0 || tc.y < 0 || static_cast<size_t>(tc.x) >= gx || static_cast<size_t>(tc.y) >= gy) continue;
+        char& s = seen[static_cast<size_t>(tc.y) * gx + tc.x];
+        if (s) continue;
+        s = 1;
+        ++n;
+        cx0 = std::min(cx0, tc.x); cy0 = std::min(cy0, tc.y);
+        cx1 = std::max(cx1, tc.x); cy1 = std::max(cy1, tc.y);
+    }
+    if (n == 0) return f;
+    f.x0 = cx0 * ts;
+    f.y0 = cy0 * ts;
+    f.x1 = std::min(clipW, (cx1 + 1) * ts);
+    f.y1 = std::min(clipH, (cy1 + 1) * ts);
+    f.tilesCovered = n == static_cast<size_t>(cx1 - cx0 + 1) * (cy1 - cy0 + 1);
+    f.frameCovered = f.tilesCovered && n == seen.size() && clipW == static_cast<int>(w) && clipH == static_cast<int>(h);
+    return f;
+}
+
+std::shared_ptr<const ProcessingPipeline::MipChain> ProcessingPipeline::acquireMips(const UnifiedRawData& data, uint64_t source,
+                                                                                  int lodNeeded, bool cfa) {
+    std::lock_guard<std::mutex> lk(mipsMutex_);
+    std::shared_ptr<const MipChain> cur;
+    for (auto it = mipCache_.begin(); it != mipCache_.end(); ++it) {
+        const MipChain& c = **it;
+        if (c.source != source || c.cfa != cfa || c.baseW != data.raw.width || c.baseH != data.raw.height) continue;
+        cur = *it;
+        mipBytes_ -= c.bytes;
+        mipCache_.erase(it);
+        break;
+    }
+    if (!cur) {
+        auto fresh = std::make_shared<MipChain>();
+        fresh->source = source;
+        fresh->baseW = data.raw.width;
+        fresh->baseH = data.raw.height;
+        fresh->cfa = cfa;
+        cur = fresh;
+    }
+    // The chain ends at the first level that is 1 pixel thin (see lodFrameSize).
+    auto thin = [](const RawImage& r) { return r.width <= 1 || r.height <= 1; };
+    if (static_cast<int>(cur->levels.size()) < lodNeeded && !thin(cur->level(data.raw, static_cast<int>(cur->levels.size())))) {
+        auto grown = std::make_shared<MipChain>(*cur);
+        while (static_cast<int>(grown->levels.size()) < lodNeeded) {
+            const RawImage& prev = grown->level(data.raw, static_cast<int>(grown->levels.size()));
+            if (thin(prev)) break;
+            grown->levels.push_back(std::make_shared<const RawImage>(downsample2x(prev, cfa)));
+            grown->bytes += grown->levels.back()->data.size() * sizeof(uint16_t);
+        }
+        cur = grown;
+    }
+    if (!cur->levels.empty()) {
+        mipCache_.push_front(cur);
+        mipBytes_ += cur->bytes;
+        mipEvictIfNeeded();
     }
-    while (static_cast<int>(rawMips_.size()) <= lodNeeded) {
-        rawMips_.push_back(downsample2x(rawMips_.back()));
-        if (rawMips_.back().width <= 1 || rawMips_.back().height <= 1) break;
+    return cur;
+}
+
+void ProcessingPipeline::mipEvictIfNeeded() {
+    // The most recent pyramid stays even if it alone exceeds the budget.
+    while (mipBytes_ > mipCapacityBytes_ && mipCache_.size() > 1) {
+        mipBytes_ -= mipCache_.back()->bytes;
+        mipCache_.pop_back();
     }
 }
 
+void ProcessingPipeline::setMipCacheCapacityMB(size_t mb) {
+    std::lock_guard<std::mutex> lk(mipsMutex_);
+    mipCapacityBytes_ = mb * 1024ull * 1024ull;
+    mipEvictIfNeeded();
+}
+
 void ProcessingPipeline::setGpuDebugMode(int mode) {
+    std::lock_guard<std::mutex> lk(gpuMutex_);
     gpuDebugMode_ = mode;
     if (gpu_) gpu_->setDebugMode(static_cast<GpuContext::DebugMode>(gpuDebugMode_));
 }
 
 void ProcessingPipeline::setGpuSynthetic(bool on) {
+    std::lock_guard<std::mutex> lk(gpuMutex_);
     gpuSynth_ = on;
     if (gpu_) gpu_->setSyntheticInput(gpuSynth_);
 }
 
-RawImage ProcessingPipeline::downsample2x(const RawImage& in) {
+void ProcessingPipeline::setNumaAware(bool on) {
+    if (on == numaAware_) return;
+    numaAware_ = on;
+    pool_ = std::make_unique<ThreadPool>(std::thread::hardware_concurrency(), numaAware_);
+}
+
+void ProcessingPipeline::parallelRows(uint32_t height, const std::function<void(uint32_t, uint32_t)>& fn) {
+    if (height == 0) return;
+    // A few bands per worker for load balance; bands never straddle a node boundary by more than a row.
+    const uint32_t bands = std::min<uint32_t>(height, static_cast<uint32_t>(std::max<size_t>(1, pool_->size() * 4)));
+    std::vector<std::future<void>> futs;
+    futs.reserve(bands);
+    for (uint32_t b = 0; b < bands; ++b) {
+        const uint32_t y0 = static_cast<uint32_t>(static_cast<uint64_t>(height) * b / bands);
+        const uint32_t y1 = static_cast<uint32_t>(static_cast<uint64_t>(height) * (b + 1) / bands);
+        if (y1 <= y0) continue;
+        futs.push_back(pool_->enqueueOnNode(pool_->nodeForRow(y0, height), [&fn, y0, y1]{ fn(y0, y1); }));
+    }
+    for (auto& f : futs) f.get();
+}
+
+RawImage ProcessingPipeline::downsample2x(const RawImage& in, bool cfa) {
     RawImage out;
     const uint32_t w = in.width;
     const uint32_t h = in.height;
     const uint32_t ow = std::max<uint32_t>(1, w / 2);
     const uint32_t oh = std::max<uint32_t>(1, h / 2);
     out.width = ow; out.height = oh;
+    // Uninitialized allocation; each band is first-touched by the node that owns it.
     out.data.resize(static_cast<size_t>(ow) * oh);
-    for (uint32_t y = 0; y < oh; ++y) {
-        uint32_t sy = y * 2;
-        for (uint32_t x = 0; x < ow; ++x) {
-            uint32_t sx = x * 2;
-            // average 2x2, clamp edges if odd
-            uint64_t sum = 0; int cnt = 0;
-            for (uint32_t dy = 0; dy < 2 && (sy+dy) < h; ++dy) {
-                for (uint32_t dx = 0; dx < 2 && (sx+dx) < w; ++dx) {
-                    sum += in.data[(sy+dy)*w + (sx+dx)]; cnt++;
+    parallelRows(oh, [&](uint32_t y0, uint32_t y1) {
+        if (cfa) {
+            // Keep the 2x2 mosaic: each site averages the 2x2 nearest sites of its own color.
+            for (uint32_t y = y0; y < y1; ++y) {
+                const uint32_t sy = 2 * y - (y & 1);
+                const uint16_t* r0 = in.row(sy);
+                const uint16_t* r1 = sy + 2 < h ? in.row(sy + 2) : r0;
+                for (uint32_t x = 0; x < ow; ++x) {
+                    const uint32_t sx = 2 * x - (x & 1);
+                    const uint32_t sx2 = sx + 2 < w ? sx + 2 : sx;
+                    const uint32_t sum = uint32_t(r0[sx]) + r0[sx2] + r1[sx] + r1[sx2];
+                    out.data[static_cast<size_t>(y) * ow + x] = static_cast<uint16_t>(sum / 4);
                 }
             }
-            out.data[y*ow + x] = static_cast<uint16_t>(sum / cnt);
+            return;
         }
-    }
+        for (uint32_t y = y0; y < y1; ++y) {
+            uint32_t sy = y * 2;
+            for (uint32_t x = 0; x < ow; ++x) {
+                uint32_t sx = x * 2;
+                // average 2x2, clamp edges if odd
+                uint64_t sum = 0; int cnt = 0;
+                for (uint32_t dy = 0; dy < 2 && (sy+dy) < h; ++dy) {
+                    const uint16_t* r = in.row(sy + dy);
+                    for (uint32_t dx = 0; dx < 2 && (sx+dx) < w; ++dx) {
+                        sum += r[sx+dx]; cnt++;
+                    }
+                }
+                out.data[static_cast<size_t>(y)*ow + x] = static_cast<uint16_t>(sum / cnt);
+            }
+        }
+    });
     return out;
 }
 
-ProcessingPipeline::PipelineHashes ProcessingPipeline::computeHashes(const UnifiedRawData& data, RenderMode mode, int tileSize, int lod) {
-    std::hash<int> Hi; std::hash<float> Hf; std::hash<std::string_view> Hsv; std::hash<size_t> Hs;
+ProcessingPipeline::PipelineHashes ProcessingPipeline::computeHashes(const UnifiedRawData& data, const ExecutionPlan& plan, int tileSize) {
+    std::hash<int> Hi; std::hash<float> Hf; std::hash<size_t> Hs;
     PipelineHashes ph;
-    // sourceHash: input dimensions + black/white + wb (acts as source characteristics for preview)
+    // sourceHash: content hash, dimensions, levels and color metadata. The content hash is the
+    // caller's (see UnifiedRawData::sourceHash); the fallback rescans the frame on every render.
+    if (data.sourceHash) {
+        ph.content = data.sourceHash;
+    } else {
+        static std::once_flag warned;
+        std::call_once(warned, []{
+            std::cerr << "ProcessingPipeline: UnifiedRawData::sourceHash is not set; hashing the raw frame on every render\n";
+        });
+        ph.content = hashRawContent(data.raw);
+    }
     ph.source = 0;
     ph.source = hashCombine(ph.source, Hi(static_cast<int>(data.raw.width)));
     ph.source = hashCombine(ph.source, Hi(static_cast<int>(data.raw.height)));
+    ph.source = hashCombine(ph.source, Hs(static_cast<size_t>(ph.content)));
     ph.source = hashCombine(ph.source, Hf(data.meta.black_level));
     ph.source = hashCombine(ph.source, Hf(data.meta.white_level));
     ph.source = hashCombine(ph.source, Hf(data.meta.wb[0]));
     ph.source = hashCombine(ph.source, Hf(data.meta.wb[1]));
     ph.source = hashCombine(ph.source, Hf(data.meta.wb[2]));
+    ph.source = hashCombine(ph.source, Hi(data.meta.bayer ? 1 : 0));
+    for (int i = 0; i < 4; ++i) {
+        ph.source = hashCombine(ph.source, Hi(data.meta.cfa[i / 2][i % 2]));
+        ph.source = hashCombine(ph.source, Hf(data.meta.cfa_black[i / 2][i % 2]));
+    }
+    for (int i = 0; i < 9; ++i) ph.source = hashCombine(ph.source, Hf(data.meta.cam_to_srgb[i / 3][i % 3]));
+    ph.source = hashCombine(ph.source, Hf(data.meta.baseline_exposure));
 
     // paramsHash: sequence of plugin identities + their stateHash
-    ph.params = 0;
-    for (const auto& step : data.history) {
-        auto inst = pm_.getInstance(step.instanceId);
-        if (!inst) continue;
-        ph.params = hashCombine(ph.params, Hsv(inst->getName()));
-        ph.params = hashCombine(ph.params, Hi(static_cast<int>(inst->getProcessingStage())));
-        ph.params = hashCombine(ph.params, Hs(inst->stateHash()));
-    }
+    ph.params = plan.paramsHash;
 
-    // geomHash: tiling, lod, rendermode
+    // geomHash: tiling, rendermode (the LOD goes into each tile key)
     ph.geom = 0;
     ph.geom = hashCombine(ph.geom, Hi(tileSize));
-    ph.geom = hashCombine(ph.geom, Hi(lod));
-    ph.geom = hashCombine(ph.geom, Hi(static_cast<int>(mode)));
+    ph.geom = hashCombine(ph.geom, Hi(static_cast<int>(plan.mode)));
 
     return ph;
 }
 
-std::shared_ptr<std::vector<float>> ProcessingPipeline::cacheLookup(size_t key, int w, int h) {
+bool ProcessingPipeline::cacheLookupAll(const std::vector<size_t>& keys, std::vector<RgbTile>& tiles) {
+    std::lock_guard<std::mutex> lk(cacheMutex_);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto it = tileCache_.find(keys[i]);
+        if (it == tileCache_.end()) return false;
+        const auto& e = it->second.tile;
+        const size_t n = static_cast<size_t>(tiles[i].width) * tiles[i].height * 3u;
+        if (e.w != static_cast<int>(tiles[i].width) || e.h != static_cast<int>(tiles[i].height) || !e.data || e.data->size() != n) return false;
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto& e = tileCache_[keys[i]];
+        tiles[i].data = e.tile.data;
+        lru_.erase(e.lruIt);
+        lru_.push_front(keys[i]);
+        e.lruIt = lru_.begin();
+    }
+    return true;
+}
+
+std::shared_ptr<PixelBuffer<float>> ProcessingPipeline::cacheLookup(size_t key, int w, int h) {
     std::lock_guard<std::mutex> lk(cacheMutex_);
     auto it = tileCache_.find(key);
     if (it == tileCache_.end()) return {};
@@ -340,7 +881,7 @@ std::shared_ptr<std::vector<float>> ProcessingPipeline::cacheLookup(size_t key,
     return e.tile.data;
 }
 
-void ProcessingPipeline::cacheInsert(size_t key, int w, int h, std::shared_ptr<std::vector<float>> data) {
+void ProcessingPipeline::cacheInsert(size_t key, const TileTag& tag, int w, int h, std::shared_ptr<PixelBuffer<float>> data) {
     const size_t bytes = static_cast<size_t>(w) * h * 3u * sizeof(float);
     std::lock_guard<std::mutex> lk(cacheMutex_);
     // If exists, update and adjust bytes
@@ -353,6 +894,7 @@ void ProcessingPipeline::cacheInsert(size_t key, int w, int h, std::shared_ptr<s
     lru_.push_front(key);
     CacheEntry e;
     e.tile.w = w; e.tile.h = h; e.tile.data = std::move(data);
+    e.tag = tag;
     e.bytes = bytes;
     e.lruIt = lru_.begin();
     tileCache_[key] = std::move(e);
@@ -372,4 +914,44 @@ void ProcessingPipeline::cacheEvictIfNeeded() {
     }
 }
 
+void ProcessingPipeline::cacheErase(std::unordered_map<size_t, CacheEntry>::iterator it) {
+    cacheBytes_ -= it->second.bytes;
+    lru_.erase(it->second.lruIt);
+    tileCache_.erase(it);
+}
+
+void ProcessingPipeline::invalidateTiles(size_t source, const PixelRegion& region, int apron) {
+    if (region.width <= 0 || region.height <= 0) return;
+    // The region on each level, as the level pixels that may read it: a mip pixel averages
+    // LOD-0 pixels up to one step beyond its 2x2 footprint (mosaic-preserving mips), so the
+    // rect grows by one pixel per level on top of the halving.
+    struct Rect { int64_t x0, y0, x1, y1; };
+    std::vector<Rect> levels{{region.x, region.y, int64_t(region.x) + region.width, int64_t(region.y) + region.height}};
+    auto floorDiv2 = [](int64_t v) { return v >= 0 ? v / 2 : -((-v + 1) / 2); };
+    std::lock_guard<std::mutex> lk(cacheMutex_);
+    for (auto it = tileCache_.begin(); it != tileCache_.end();) {
+        const TileTag& t = it->second.tag;
+        if (t.source != source) { ++it; continue; }
+        while (static_cast<int>(levels.size()) <= t.lod) {
+            const Rect& r = levels.back();
+            levels.push_back({floorDiv2(r.x0) - 1, floorDiv2(r.y0) - 1, floorDiv2(r.x1 + 1) + 1, floorDiv2(r.y1 + 1) + 1});
+        }
+        const Rect& r = levels[t.lod];
+        const bool hit = t.x < r.x1 + apron && r.x0 - apron < int64_t(t.x) + it->second.tile.w &&
+                         t.y < r.y1 + apron && r.y0 - apron < int64_t(t.y) + it->second.tile.h;
+        if (hit) cacheErase(it++);
+        else ++it;
+    }
+}
+
+void ProcessingPipeline::invalidateRegion(const UnifiedRawData& data, const PixelRegion& region) {
+    const auto plan = executionPlan(data, RenderMode::FullColor);
+    // Only the source part of the hashes is needed.
+    invalidateTiles(computeHashes(data, *plan, 0).source, region, plan->rawApron);
+    if (plan->analysisLod >= 0) {
+        std::lock_guard<std::mutex> lk(analysisMutex_);
+        analysisCache_.clear();
+    }
+}
+
 } // namespace rawproc
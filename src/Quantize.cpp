@@ -0,0 +1,147 @@
+#include "rawproc/Quantize.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define RAWPROC_QUANT_SSE2 1
+#endif
+
+namespace rawproc {
+
+namespace {
+
+// 8x8 Bayer threshold matrix (values 0..63).
+constexpr uint8_t kBayer8[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21},
+};
+
+inline uint8_t quantize1(float v, float bias) {
+    float q = v * 255.0f + bias;
+    // Written so that NaN falls through to 0.
+    q = q > 0.0f ? q : 0.0f;
+    q = q < 255.0f ? q : 255.0f;
+    return static_cast<uint8_t>(q);
+}
+
+// One row. `bias` holds the rounding offset (+ dither) per element with period `period`
+// elements and at least period + 16 entries, so 16-wide loads never wrap.
+void quantizeRow(const float* src, uint8_t* dst, size_t n, const float* bias, size_t period) {
+    size_t i = 0;
+#if defined(RAWPROC_QUANT_SSE2)
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 lo = _mm_setzero_ps();
+    const __m128 hi = _mm_set1_ps(255.0f);
+    for (; i + 16 <= n; i += 16) {
+        const float* b = bias + (i % period);
+        __m128i q[4];
+        for (int k = 0; k < 4; ++k) {
+            __m128 v = _mm_loadu_ps(src + i + 4 * k);
+            v = _mm_add_ps(_mm_mul_ps(v, scale), _mm_loadu_ps(b + 4 * k));
+            // max(v, lo) returns lo for NaN
+            v = _mm_min_ps(_mm_max_ps(v, lo), hi);
+            q[k] = _mm_cvttps_epi32(v);
+        }
+        const __m128i w0 = _mm_packs_epi32(q[0], q[1]);
+        const __m128i w1 = _mm_packs_epi32(q[2], q[3]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(w0, w1));
+    }
+#endif
+    for (; i < n; ++i) dst[i] = quantize1(src[i], bias[i % period]);
+}
+
+} // namespace
+
+void quantizeRowsU8(const float* src, size_t srcStride, uint8_t* dst, size_t dstStride,
+                    uint32_t width, uint32_t height, uint32_t channels,
+                    int originX, int originY, const QuantizeOptions& opt) {
+    if (width == 0 || height == 0 || channels == 0) return;
+    const size_t n = static_cast<size_t>(width) * channels;
+    const size_t period = 8u * channels;
+    std::vector<float> bias(period + 16, 0.5f);
+    for (uint32_t y = 0; y < height; ++y) {
+        if (opt.dither) {
+            const auto& row = kBayer8[static_cast<unsigned>(originY + static_cast<int>(y)) & 7u];
+            for (size_t k = 0; k < bias.size(); ++k) {
+                const unsigned px = static_cast<unsigned>(originX + static_cast<int>(k / channels)) & 7u;
+                // Replaces the 0.5 rounding offset with a threshold in (0, 1).
+                bias[k] = (static_cast<float>(row[px]) + 0.5f) / 64.0f;
+            }
+        }
+        quantizeRow(src + y * srcStride, dst + y * dstStride, n, bias.data(), period);
+    }
+}
+
+void quantizeRowsU16(const float* src, size_t srcStride, uint16_t* dst, size_t dstStride,
+                     uint32_t width, uint32_t height, uint32_t channels, bool bigEndian) {
+    const size_t n = static_cast<size_t>(width) * channels;
+    const uint16_t one = 1;
+    const bool hostLittle = *reinterpret_cast<const uint8_t*>(&one) == 1;
+    const bool swap = bigEndian == hostLittle;
+    for (uint32_t y = 0; y < height; ++y) {
+        const float* s = src + y * srcStride;
+        uint16_t* d = dst + y * dstStride;
+        // Branch-free body so the compiler can vectorize it.
+        for (size_t i = 0; i < n; ++i) {
+            float q = s[i] * 65535.0f + 0.5f;
+            q = q > 0.0f ? q : 0.0f;
+            q = q < 65535.0f ? q : 65535.0f;
+            const uint16_t v = static_cast<uint16_t>(q);
+            d[i] = swap ? static_cast<uint16_t>((v >> 8) | (v << 8)) : v;
+        }
+    }
+}
+
+PixelBuffer<uint8_t> quantizeU8(const RgbImageF& img, const QuantizeOptions& opt, ITaskScheduler* sched) {
+    const size_t stride = static_cast<size_t>(img.width) * 3u;
+    PixelBuffer<uint8_t> out(stride * img.height);
+    if (out.empty() || img.data.size() < out.size()) return out;
+    auto rows = [&](size_t y0, size_t y1) {
+        quantizeRowsU8(img.data.data() + y0 * stride, stride, out.data() + y0 * stride, stride,
+                       img.width, static_cast<uint32_t>(y1 - y0), 3u, 0, static_cast<int>(y0), opt);
+    };
+    if (sched) sched->parallelFor(img.height, 32, rows);
+    else rows(0, img.height);
+    return out;
+}
+
+PixelBuffer<uint8_t> quantizeU8(const RgbTileSet& ts, const QuantizeOptions& opt, ITaskScheduler* sched) {
+    const size_t stride = static_cast<size_t>(ts.width) * 3u;
+    PixelBuffer<uint8_t> out(stride * ts.height);
+    if (out.empty()) return out;
+    // Zero only when the tiles leave holes.
+    size_t covered = 0;
+    for (const auto& t : ts.tiles) covered += static_cast<size_t>(t.width) * t.height;
+    if (covered < static_cast<size_t>(ts.width) * ts.height) std::memset(out.data(), 0, out.size());
+
+    auto tiles = [&](size_t t0, size_t t1) {
+        for (size_t ti = t0; ti < t1; ++ti) {
+            const auto& t = ts.tiles[ti];
+            if (!t.data || t.data->size() < static_cast<size_t>(t.width) * t.height * 3u) continue;
+            // Clip to the frame
+            const int x0 = std::max(0, t.x), y0 = std::max(0, t.y);
+            const int x1 = std::min<int>(static_cast<int>(ts.width), t.x + static_cast<int>(t.width));
+            const int y1 = std::min<int>(static_cast<int>(ts.height), t.y + static_cast<int>(t.height));
+            if (x1 <= x0 || y1 <= y0) continue;
+            const size_t tStride = static_cast<size_t>(t.width) * 3u;
+            const float* src = t.data->data() + static_cast<size_t>(y0 - t.y) * tStride + static_cast<size_t>(x0 - t.x) * 3u;
+            uint8_t* dst = out.data() + static_cast<size_t>(y0) * stride + static_cast<size_t>(x0) * 3u;
+            quantizeRowsU8(src, tStride, dst, stride, static_cast<uint32_t>(x1 - x0), static_cast<uint32_t>(y1 - y0),
+                           3u, x0, y0, opt);
+        }
+    };
+    if (sched) sched->parallelFor(ts.tiles.size(), 1, tiles);
+    else tiles(0, ts.tiles.size());
+    return out;
+}
+
+} // namespace rawproc
@@ -1,18 +1,231 @@
 #include "rawproc/RawLoader.h"
+#include "rawproc/ThreadPool.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 namespace rawproc {
 
 #if !defined(RAWPROC_HAVE_LIBRAW)
-std::optional<UnifiedRawData> RawLoader::load(const std::filesystem::path& path) {
+std::optional<UnifiedRawData> RawLoader::decode(const std::filesystem::path& path,
+                                                const std::function<void(size_t)>& reserve) {
     // Placeholder loader: creates a dummy RAW image when LibRaw is not enabled.
+    (void)path;
     UnifiedRawData out;
     out.raw.width = 640;
     out.raw.height = 480;
+    if (reserve) reserve(static_cast<size_t>(out.raw.width) * out.raw.height * sizeof(uint16_t));
     out.raw.data.resize(static_cast<size_t>(out.raw.width) * out.raw.height, 512);
+    out.sourceHash = hashRawContent(out.raw);
     return out;
 }
+
+std::optional<Thumbnail> RawLoader::loadThumbnail(const std::filesystem::path& path, const ThumbnailOptions& opt) {
+    // Placeholder: gray bitmap matching the dummy RAW's aspect ratio.
+    (void)path;
+    Thumbnail t;
+    const uint32_t edge = opt.maxSize ? opt.maxSize : 640;
+    t.width = edge;
+    t.height = edge * 3 / 4;
+    t.rgb.resize(static_cast<size_t>(t.width) * t.height * 3u, 2);
+    return t;
+}
 #endif
 
+// Background decoding state: a dedicated pool, the memory budget, and prefetched results
+// waiting to be claimed. A reservation is returned once the image belongs to a caller: when a
+// loadAsync() decode finishes, when a prefetch is claimed (or, if claimed early, when it
+// finishes), or when an unclaimed prefetch is dropped (if still decoding, when it finishes). Claims never occupy a pool thread, so
+// decodes waiting for budget cannot starve the claim that would free it.
+struct RawLoader::Background {
+    using Result = std::optional<UnifiedRawData>;
+
+    struct Slot {
+        std::future<Result> result;
+        size_t bytes = 0;   // reserved; written under `m` before the result is set
+        bool ready = false;   // decode finished (eligible for eviction)
+        bool claimed = false;
+        bool dropped = false; // removed unclaimed by clearPrefetched(); a queued decode is skipped
+        uint64_t order = 0;
+    };
+
+    Background(size_t threads, size_t budgetBytes) : budget(budgetBytes), pool(threads) {}
+    ~Background() { cancelled = true; } // queued prefetches bail out; the pool then drains
+
+    // Blocks until `n` bytes fit, evicting the oldest finished prefetch when that makes room.
+    void reserve(size_t n, size_t& held) {
+        std::unique_lock<std::mutex> lk(m);
+        while (used > 0 && used + n > budget) {
+            if (!evictOldestReady()) cv.wait(lk);
+        }
+        used += n;
+        held = n;
+    }
+
+    void release(size_t n) {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            used -= std::min(used, n);
+        }
+        cv.notify_all();
+    }
+
+    bool evictOldestReady() {
+        auto victim = prefetched.end();
+        for (auto it = prefetched.begin(); it != prefetched.end(); ++it) {
+            if (it->second->ready && (victim == prefetched.end() || it->second->order < victim->second->order)) victim = it;
+        }
+        if (victim == prefetched.end()) return false;
+        victim->second->dropped = true;
+        used -= std::min(used, victim->second->bytes);
+        prefetched.erase(victim);
+        cv.notify_all();
+        return true;
+    }
+
+    // Claims a prefetch of `key`, if any: removes it from the table and hands its reservation
+    // back now, or when the decode finishes if it is still running.
+    std::shared_ptr<Slot> take(const std::string& key) {
+        std::shared_ptr<Slot> slot;
+        {
+            std::lock_guard<std::mutex> lk(m);
+            auto it = prefetched.find(key);
+            if (it == prefetched.end()) return nullptr;
+            slot = std::move(it->second);
+            prefetched.erase(it);
+            slot->claimed = true;
+            if (!slot->ready) return slot;
+            used -= std::min(used, slot->bytes);
+        }
+        cv.notify_all();
+        return slot;
+    }
+
+    std::mutex m;
+    std::condition_variable cv;
+    size_t budget;
+    size_t used = 0;
+    uint64_t nextOrder = 0;
+    std::unordered_map<std::string, std::shared_ptr<Slot>> prefetched;
+    std::atomic<bool> cancelled{false};
+    ThreadPool pool; // last: joined before the state above is destroyed
+};
+
+RawLoader::RawLoader() = default;
+RawLoader::~RawLoader() = default;
+
+RawLoader::Background& RawLoader::background() {
+    if (!bg_) {
+        size_t n = decodeThreads_;
+        if (n == 0) n = std::min<size_t>(4, std::max(1u, std::thread::hardware_concurrency()));
+        bg_ = std::make_unique<Background>(n, memoryBudget_);
+    }
+    return *bg_;
+}
+
+void RawLoader::setMemoryBudget(size_t bytes) {
+    memoryBudget_ = bytes;
+    if (bg_) {
+        {
+            std::lock_guard<std::mutex> lk(bg_->m);
+            bg_->budget = bytes;
+        }
+        bg_->cv.notify_all();
+    }
+}
+
+std::optional<UnifiedRawData> RawLoader::load(const std::filesystem::path& path) {
+    if (bg_) {
+        if (auto slot = bg_->take(path.string())) return slot->result.get();
+    }
+    return decode(path, {});
+}
+
+std::future<std::optional<UnifiedRawData>> RawLoader::loadAsync(const std::filesystem::path& path) {
+    Background& bg = background();
+    if (auto slot = bg.take(path.string())) return std::move(slot->result);
+    return bg.pool.enqueue([&bg, path]() -> Background::Result {
+        if (bg.cancelled) return std::nullopt; // loader shutting down
+        size_t held = 0;
+        struct Release {
+            Background& bg;
+            size_t& held;
+            ~Release() { bg.release(held); }
+        } release{bg, held};
+        return decode(path, [&](size_t n) { bg.reserve(n, held); });
+    });
+}
+
+void RawLoader::prefetch(const std::filesystem::path& path) {
+    Background& bg = background();
+    // The slot owns the future and the task the promise. The task keeps the slot until it
+    // finishes, so a claim that drops its reference early (loadAsync) still gets the decode; a
+    // dropped or claimed slot frees its image as soon as the last of them lets go.
+    auto slot = std::make_shared<Background::Slot>();
+    auto promise = std::make_shared<std::promise<Background::Result>>();
+    {
+        std::lock_guard<std::mutex> lk(bg.m);
+        auto& entry = bg.prefetched[path.string()];
+        if (entry) return; // already prefetching
+        slot->order = bg.nextOrder++;
+        slot->result = promise->get_future();
+        entry = slot;
+    }
+    bg.pool.enqueue([&bg, slot, promise, path] {
+        // Bytes reserved for the decode; handed to the slot (or released) when it finishes.
+        size_t held = 0;
+        Background::Result r;
+        std::exception_ptr err;
+        bool skip;
+        {
+            std::lock_guard<std::mutex> lk(bg.m);
+            skip = slot->dropped;
+        }
+        try {
+            if (!bg.cancelled && !skip) r = decode(path, [&](size_t n) { bg.reserve(n, held); });
+        } catch (...) {
+            err = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lk(bg.m);
+            if (slot->claimed || slot->dropped) {
+                bg.used -= std::min(bg.used, held);
+            } else {
+                slot->bytes = held; // returned when the prefetch is claimed or evicted
+            }
+            slot->ready = true;
+        }
+        bg.cv.notify_all();
+        if (err) promise->set_exception(err);
+        else promise->set_value(std::move(r));
+    });
+}
+
+void RawLoader::clearPrefetched() {
+    if (!bg_) return;
+    {
+        std::lock_guard<std::mutex> lk(bg_->m);
+        while (bg_->evictOldestReady()) {}
+        // Still decoding or queued: their tasks release the reservation when they finish.
+        for (auto& [key, slot] : bg_->prefetched) slot->dropped = true;
+        bg_->prefetched.clear();
+    }
+    bg_->cv.notify_all();
+}
+
+std::vector<std::optional<Thumbnail>> RawLoader::loadThumbnails(const std::vector<std::filesystem::path>& paths,
+                                                                ITaskScheduler& sched, const ThumbnailOptions& opt) {
+    std::vector<std::optional<Thumbnail>> out(paths.size());
+    // One file per chunk: files differ wildly in cost, so keep the load balanced.
+    sched.parallelFor(paths.size(), 1, [&](size_t i0, size_t i1) {
+        for (size_t i = i0; i < i1; ++i) out[i] = loadThumbnail(paths[i], opt);
+    });
+    return out;
+}
+
 } // namespace rawproc
@@ -3,48 +3,50 @@
 #if defined(RAWPROC_HAVE_LIBRAW)
 
 #include <libraw/libraw.h>
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <cstring>
 
 namespace rawproc {
 
-static bool load_raw_with_libraw(const std::filesystem::path& path, UnifiedRawData& out) {
-    LibRaw proc;
+static bool load_raw_with_libraw(const std::filesystem::path& path, UnifiedRawData& out,
+                                 const std::function<void(size_t)>& reserve) {
+    // Heap instance kept alive by the image: the active area is a view into its raw plate, which
+    // is released (~LibRaw recycles) when the last copy of the image lets go.
+    auto owner = std::make_shared<LibRaw>();
+    LibRaw& proc = *owner;
     if (proc.open_file(path.string().c_str()) != LIBRAW_SUCCESS) {
         std::cerr << "LibRaw: open_file failed: " << path << "\n";
         return false;
     }
+    if (reserve) {
+        // LibRaw's unpacked raw plate (the image references it directly).
+        const auto& sz = proc.imgdata.sizes;
+        reserve(static_cast<size_t>(sz.raw_width) * sz.raw_height * sizeof(uint16_t));
+    }
     if (proc.unpack() != LIBRAW_SUCCESS) {
         std::cerr << "LibRaw: unpack failed\n";
-        proc.recycle();
         return false;
     }
+    // The image keeps the LibRaw instance alive; the file handle and stream buffers are not
+    // needed past unpack().
+    proc.recycle_datastream();
 
     auto& sizes = proc.imgdata.sizes;
     auto* rawp = proc.imgdata.rawdata.raw_image; // 16-bit buffer
     if (!rawp) {
         std::cerr << "LibRaw: raw_image is null (possibly non-Bayer sensor)\n";
-        proc.recycle();
         return false;
     }
 
-    const uint32_t rw = sizes.raw_width;
-    const uint32_t rh = sizes.raw_height;
-    const uint32_t left = sizes.left_margin;
-    const uint32_t top  = sizes.top_margin;
-    const uint32_t w = sizes.width;   // active area
-    const uint32_t h = sizes.height;  // active area
-    out.raw.width = w;
-    out.raw.height = h;
-    out.raw.data.resize(static_cast<size_t>(w) * h);
-
-    // Copy only active area, skipping masked margins to avoid black edges
-    for (uint32_t y = 0; y < h; ++y) {
-        const uint16_t* src = rawp + (top + y) * rw + left;
-        uint16_t* dst = out.raw.data.data() + static_cast<size_t>(y) * w;
-        std::memcpy(dst, src, static_cast<size_t>(w) * sizeof(uint16_t));
-    }
+    // Active area as a view, skipping masked margins to avoid black edges
+    const size_t pitch = sizes.raw_pitch ? sizes.raw_pitch / sizeof(uint16_t) : sizes.raw_width;
+    out.raw.width = sizes.width;
+    out.raw.height = sizes.height;
+    out.raw.view = rawp + static_cast<size_t>(sizes.top_margin) * pitch + sizes.left_margin;
+    out.raw.stride = pitch;
 
     // White balance estimates
     out.meta.wb[0] = proc.imgdata.color.cam_mul[0] != 0 ? proc.imgdata.color.cam_mul[0] : 1.0f;
@@ -57,16 +59,158 @@ static bool load_raw_with_libraw(const std::filesystem::path& path, UnifiedRawDa
     if (maximum <= 0) maximum = 65535;
     out.meta.white_level = static_cast<float>(maximum);
 
-    proc.recycle();
+    // CFA layout and per-site black (cblack[0..3] per color, cblack[6..] an optional repeating
+    // pattern of cblack[4] x cblack[5] sites), both relative to the active area
+    const auto& color = proc.imgdata.color;
+    const unsigned filters = proc.imgdata.idata.filters;
+    out.meta.bayer = proc.imgdata.idata.colors == 3 && filters > 1000; // 0 none, 1/2 Leaf, 9 X-Trans
+    for (int r = 0; r < 2; ++r) {
+        for (int c = 0; c < 2; ++c) {
+            const int site = proc.COLOR(r, c);
+            float black = static_cast<float>(color.cblack[site & 3]);
+            if (color.cblack[4] && color.cblack[5]) {
+                black += static_cast<float>(color.cblack[6 + (r % color.cblack[4]) * color.cblack[5] + c % color.cblack[5]]);
+            }
+            out.meta.cfa[r][c] = static_cast<uint8_t>(site & 3);
+            out.meta.cfa_black[r][c] = black;
+        }
+    }
+
+    // rgb_cam maps white-balanced camera RGB to sRGB; XYZ follows from the sRGB primaries
+    static const float srgbToXyz[3][3] = {{0.412453f, 0.357580f, 0.180423f},
+                                          {0.212671f, 0.715160f, 0.072169f},
+                                          {0.019334f, 0.119193f, 0.950227f}};
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) out.meta.cam_to_srgb[i][j] = color.rgb_cam[i][j];
+    }
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            float acc = 0.0f;
+            for (int k = 0; k < 3; ++k) acc += srgbToXyz[i][k] * color.rgb_cam[k][j];
+            out.meta.cam_to_xyz[i][j] = acc;
+        }
+    }
+#if LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0, 20)
+    out.meta.baseline_exposure = color.dng_levels.baseline_exposure;
+#endif
+
+    out.raw.owner = std::move(owner);
+    out.sourceHash = hashRawContent(out.raw);
     return true;
 }
 
-std::optional<UnifiedRawData> RawLoader::load(const std::filesystem::path& path) {
+std::optional<UnifiedRawData> RawLoader::decode(const std::filesystem::path& path,
+                                                const std::function<void(size_t)>& reserve) {
     UnifiedRawData out;
-    if (load_raw_with_libraw(path, out)) return out;
+    if (load_raw_with_libraw(path, out, reserve)) return out;
     return std::nullopt;
 }
 
+// Box-filters an 8-bit RGB bitmap so its longest edge is at most maxSize.
+static void fit_rgb8(Thumbnail& t, uint32_t maxSize) {
+    const uint32_t longest = std::max(t.width, t.height);
+    if (maxSize == 0 || longest <= maxSize) return;
+    const uint32_t f = (longest + maxSize - 1) / maxSize;
+    const uint32_t w = std::max(1u, t.width / f), h = std::max(1u, t.height / f);
+    PixelBuffer<uint8_t> out(static_cast<size_t>(w) * h * 3u);
+    for (uint32_t y = 0; y < h; ++y) {
+        for (uint32_t x = 0; x < w; ++x) {
+            uint32_t acc[3] = {0, 0, 0};
+            for (uint32_t dy = 0; dy < f; ++dy) {
+                const uint8_t* src = t.rgb.data() + (static_cast<size_t>(y * f + dy) * t.width + x * f) * 3u;
+                for (uint32_t dx = 0; dx < f; ++dx, src += 3) {
+                    acc[0] += src[0]; acc[1] += src[1]; acc[2] += src[2];
+                }
+            }
+            uint8_t* dst = out.data() + (static_cast<size_t>(y) * w + x) * 3u;
+            for (int c = 0; c < 3; ++c) dst[c] = static_cast<uint8_t>(acc[c] / (f * f));
+        }
+    }
+    t.rgb = std::move(out);
+    t.width = w;
+    t.height = h;
+}
+
+// Embedded preview. With several previews in the file (LibRaw >= 0.21), unpacks the smallest
+// JPEG/RGB one that still covers maxSize, or the largest if none does.
+static bool load_embedded_thumb(LibRaw& proc, const ThumbnailOptions& opt, Thumbnail& t) {
+#if LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0, 21)
+    const auto& list = proc.imgdata.thumbs_list;
+    int pick = -1;
+    for (int i = 0; i < list.thumbcount; ++i) {
+        const auto& it = list.thumblist[i];
+        if (it.tformat != LIBRAW_INTERNAL_THUMBNAIL_JPEG && it.tformat != LIBRAW_INTERNAL_THUMBNAIL_PPM) continue;
+        const int edge = std::max<int>(it.twidth, it.theight);
+        if (pick < 0) { pick = i; continue; }
+        const int best = std::max<int>(list.thumblist[pick].twidth, list.thumblist[pick].theight);
+        const int want = static_cast<int>(opt.maxSize);
+        const bool covers = edge >= want, bestCovers = best >= want;
+        if ((covers && (!bestCovers || edge < best)) || (!covers && !bestCovers && edge > best)) pick = i;
+    }
+    const int rc = pick >= 0 ? proc.unpack_thumb_ex(pick) : proc.unpack_thumb();
+#else
+    (void)opt;
+    const int rc = proc.unpack_thumb();
+#endif
+    if (rc != LIBRAW_SUCCESS) return false;
+    const auto& th = proc.imgdata.thumbnail;
+    if (!th.thumb || th.tlength == 0) return false;
+    if (th.tformat == LIBRAW_THUMBNAIL_JPEG) {
+        t.kind = Thumbnail::Kind::Jpeg;
+        t.jpeg.assign(reinterpret_cast<const uint8_t*>(th.thumb), reinterpret_cast<const uint8_t*>(th.thumb) + th.tlength);
+    } else if (th.tformat == LIBRAW_THUMBNAIL_BITMAP && th.tcolors == 3 &&
+               th.tlength >= static_cast<unsigned>(th.twidth) * th.theight * 3u) {
+        t.kind = Thumbnail::Kind::Bitmap;
+        t.rgb.assign(reinterpret_cast<const uint8_t*>(th.thumb),
+                     reinterpret_cast<const uint8_t*>(th.thumb) + static_cast<size_t>(th.twidth) * th.theight * 3u);
+    } else {
+        return false; // 16-bit / layered / other preview kinds: use the half-size decode
+    }
+    t.width = th.twidth;
+    t.height = th.theight;
+    return true;
+}
+
+// Half-size decode: every 2x2 CFA block becomes one pixel, so no demosaic is needed.
+static bool load_half_size(LibRaw& proc, const ThumbnailOptions& opt, Thumbnail& t) {
+    auto& params = proc.imgdata.params;
+    params.half_size = 1;
+    params.output_bps = 8;
+    params.use_camera_wb = 1;
+    if (proc.unpack() != LIBRAW_SUCCESS || proc.dcraw_process() != LIBRAW_SUCCESS) return false;
+    int err = 0;
+    libraw_processed_image_t* img = proc.dcraw_make_mem_image(&err);
+    if (!img) return false;
+    const bool ok = img->type == LIBRAW_IMAGE_BITMAP && img->colors == 3 && img->bits == 8;
+    if (ok) {
+        t.kind = Thumbnail::Kind::Bitmap;
+        t.width = img->width;
+        t.height = img->height;
+        t.rgb.assign(img->data, img->data + static_cast<size_t>(img->width) * img->height * 3u);
+        // dcraw_make_mem_image already applies the orientation
+        t.flip = 0;
+        fit_rgb8(t, opt.maxSize);
+    }
+    LibRaw::dcraw_clear_mem(img);
+    return ok;
+}
+
+std::optional<Thumbnail> RawLoader::loadThumbnail(const std::filesystem::path& path, const ThumbnailOptions& opt) {
+    LibRaw proc;
+    if (proc.open_file(path.string().c_str()) != LIBRAW_SUCCESS) {
+        std::cerr << "LibRaw: open_file failed: " << path << "\n";
+        return std::nullopt;
+    }
+    Thumbnail t;
+    t.flip = proc.imgdata.sizes.flip;
+    bool ok = opt.allowEmbedded && load_embedded_thumb(proc, opt, t);
+    if (ok && t.kind == Thumbnail::Kind::Bitmap) fit_rgb8(t, opt.maxSize);
+    if (!ok && opt.allowHalfSize) ok = load_half_size(proc, opt, t);
+    proc.recycle();
+    if (!ok) return std::nullopt;
+    return t;
+}
+
 } // namespace rawproc
 
 #endif // RAWPROC_HAVE_LIBRAW
@@ -1,12 +1,24 @@
 #include "rawproc/ThreadPool.h"
 
+#include <atomic>
+#include <exception>
+
 namespace rawproc {
 
-ThreadPool::ThreadPool(size_t n) {
+ThreadPool::ThreadPool(size_t n, bool numaAware) {
     if (n == 0) n = 1;
+    if (numaAware) {
+        topo_ = pal::NumaTopology::detect();
+        nodeCount_ = std::min(topo_.nodeCount(), n);
+    }
+    queues_.resize(nodeCount_ + 1);
     threads_.reserve(n);
     for (size_t i = 0; i < n; ++i) {
-        threads_.emplace_back([this]{ worker(); });
+        const size_t node = i * nodeCount_ / n;
+        threads_.emplace_back([this, node]{
+            if (nodeCount_ > 1) pal::pinCurrentThread(topo_.nodeCpus[node]);
+            worker(node);
+        });
     }
 }
 
@@ -19,19 +31,75 @@ ThreadPool::~ThreadPool() {
     for (auto& t : threads_) if (t.joinable()) t.join();
 }
 
-void ThreadPool::worker() {
+bool ThreadPool::popLocked(size_t node, std::function<void()>& job) {
+    // Own node first, then unpinned work, then steal from other nodes.
+    auto take = [&](size_t q) {
+        if (queues_[q].empty()) return false;
+        job = std::move(queues_[q].front());
+        queues_[q].pop();
+        return true;
+    };
+    if (take(node) || take(sharedQueue())) return true;
+    for (size_t k = 1; k < nodeCount_; ++k) {
+        if (take((node + k) % nodeCount_)) return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker(size_t node) {
     for (;;) {
         std::function<void()> job;
         {
             std::unique_lock<std::mutex> lk(m_);
-            cv_.wait(lk, [this]{ return stop_ || !q_.empty(); });
-            if (stop_ && q_.empty()) return;
-            job = std::move(q_.front());
-            q_.pop();
+            cv_.wait(lk, [&]{ return popLocked(node, job) || stop_; });
+            if (!job) return;
         }
         job();
     }
 }
 
-} // namespace rawproc
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) return;
+    if (grain == 0) grain = 1;
+    const size_t chunks = (count + grain - 1) / grain;
+    if (chunks == 1 || threads_.empty()) { body(0, count); return; }
 
+    // Shared with helper tasks, which may start after the loop has finished (they then find no
+    // chunk left and return without touching body).
+    struct State {
+        std::atomic<size_t> next{0};
+        size_t done = 0; // guarded by m
+        std::mutex m;
+        std::condition_variable cv;
+        std::exception_ptr err;
+    };
+    auto st = std::make_shared<State>();
+    const auto* fn = &body;
+    auto drain = [st, fn, count, grain, chunks]{
+        for (;;) {
+            const size_t c = st->next.fetch_add(1);
+            if (c >= chunks) return;
+            const size_t b = c * grain;
+            std::exception_ptr err;
+            try {
+                (*fn)(b, std::min(count, b + grain));
+            } catch (...) {
+                err = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lk(st->m);
+            if (err && !st->err) st->err = err;
+            if (++st->done == chunks) st->cv.notify_all();
+        }
+    };
+
+    const size_t helpers = std::min(threads_.size(), chunks - 1);
+    for (size_t i = 0; i < helpers; ++i) push(sharedQueue(), drain);
+    // Once the caller's drain returns every chunk has been taken; the ones still running are on
+    // threads that are already executing them, so blocking here cannot deadlock.
+    drain();
+    std::unique_lock<std::mutex> lk(st->m);
+    st->cv.wait(lk, [&]{ return st->done == chunks; });
+    if (st->err) std::rethrow_exception(st->err);
+}
+
+} // namespace rawproc
@@ -0,0 +1,199 @@
+#include "rawproc/TiffEncoder.h"
+#include "rawproc/ImageTypes.h"
+#include "rawproc/PAL/File.h"
+
+#include <algorithm>
+#include <atomic>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+
+#if defined(RAWPROC_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace rawproc {
+
+namespace {
+
+enum : uint16_t { kShort = 3, kLong = 4, kRational = 5 };
+
+void le16(std::vector<uint8_t>& v, uint16_t x) {
+    v.push_back(static_cast<uint8_t>(x)); v.push_back(static_cast<uint8_t>(x >> 8));
+}
+void le32(std::vector<uint8_t>& v, uint32_t x) {
+    le16(v, static_cast<uint16_t>(x)); le16(v, static_cast<uint16_t>(x >> 16));
+}
+
+// TIFF predictor 2: each sample minus the same channel of the previous pixel, right to left.
+void differenceRow(uint8_t* row, size_t samples, uint32_t channels, int bitDepth) {
+    if (bitDepth == 8) {
+        for (size_t i = samples; i-- > channels;) row[i] = static_cast<uint8_t>(row[i] - row[i - channels]);
+        return;
+    }
+    auto get = [&](size_t i) { return static_cast<uint16_t>(row[2 * i] | (row[2 * i + 1] << 8)); };
+    for (size_t i = samples; i-- > channels;) {
+        const uint16_t d = static_cast<uint16_t>(get(i) - get(i - channels));
+        row[2 * i] = static_cast<uint8_t>(d);
+        row[2 * i + 1] = static_cast<uint8_t>(d >> 8);
+    }
+}
+
+// Entries must be added in ascending tag order. Values that do not fit the 4-byte field go to an
+// extra area placed right after the IFD.
+struct IfdBuilder {
+    struct Entry { uint16_t tag, type; uint32_t count; std::vector<uint8_t> value; };
+    std::vector<Entry> entries;
+
+    void shorts(uint16_t tag, std::initializer_list<uint16_t> vals) {
+        Entry e{tag, kShort, static_cast<uint32_t>(vals.size()), {}};
+        for (uint16_t x : vals) le16(e.value, x);
+        entries.push_back(std::move(e));
+    }
+    void longs(uint16_t tag, const std::vector<uint32_t>& vals) {
+        Entry e{tag, kLong, static_cast<uint32_t>(vals.size()), {}};
+        for (uint32_t x : vals) le32(e.value, x);
+        entries.push_back(std::move(e));
+    }
+    void rational(uint16_t tag, uint32_t num, uint32_t den) {
+        Entry e{tag, kRational, 1, {}};
+        le32(e.value, num); le32(e.value, den);
+        entries.push_back(std::move(e));
+    }
+
+    // Serializes the IFD for placement at file offset `at` (must be even).
+    std::vector<uint8_t> build(uint32_t at) const {
+        std::vector<uint8_t> ifd, extra;
+        const uint32_t extraAt = at + 2u + 12u * static_cast<uint32_t>(entries.size()) + 4u;
+        le16(ifd, static_cast<uint16_t>(entries.size()));
+        for (const auto& e : entries) {
+            le16(ifd, e.tag); le16(ifd, e.type); le32(ifd, e.count);
+            if (e.value.size() <= 4) {
+                ifd.insert(ifd.end(), e.value.begin(), e.value.end());
+                ifd.resize(ifd.size() + 4 - e.value.size(), 0);
+            } else {
+                le32(ifd, extraAt + static_cast<uint32_t>(extra.size()));
+                extra.insert(extra.end(), e.value.begin(), e.value.end());
+                if (extra.size() & 1u) extra.push_back(0);
+            }
+        }
+        le32(ifd, 0); // no next IFD
+        ifd.insert(ifd.end(), extra.begin(), extra.end());
+        return ifd;
+    }
+};
+
+} // namespace
+
+bool writeTiff(const std::filesystem::path& path, uint32_t width, uint32_t height,
+               uint32_t channels, int bitDepth,
+               const std::function<void(uint32_t, uint32_t, uint8_t*)>& rows,
+               const TiffOptions& opt, ITaskScheduler* sched) {
+    if (!rows || width == 0 || height == 0 || (channels != 1 && channels != 3)) return false;
+    if (bitDepth != 8 && bitDepth != 16) return false;
+#if defined(RAWPROC_HAVE_ZLIB)
+    const bool deflated = opt.compression == TiffCompression::Deflate;
+#else
+    const bool deflated = false;
+#endif
+    const size_t samples = static_cast<size_t>(width) * channels;
+    const size_t rowBytes = samples * (bitDepth / 8);
+    uint32_t stripRows = opt.rowsPerStrip;
+    if (stripRows == 0) stripRows = static_cast<uint32_t>(std::max<size_t>(1, (deflated ? 256u << 10 : 1u << 20) / rowBytes));
+    stripRows = std::min(stripRows, height);
+    const size_t nStrips = (height + stripRows - 1) / stripRows;
+    if (rowBytes * height > std::numeric_limits<uint32_t>::max() - (1u << 20)) return false;
+
+    auto run = [&](size_t count, const std::function<void(size_t, size_t)>& body) {
+        if (sched) sched->parallelFor(count, 1, body);
+        else body(0, count);
+    };
+
+    pal::OutputFile f;
+    if (!f.open(path)) return false;
+    std::vector<uint32_t> offsets(nStrips), counts(nStrips);
+    uint64_t end = 8; // image data follows the header
+    auto stripRange = [&](size_t s, uint32_t& y0, uint32_t& y1) {
+        y0 = static_cast<uint32_t>(s * stripRows);
+        y1 = std::min<uint32_t>(height, y0 + stripRows);
+    };
+
+    if (!deflated) {
+        // Offsets are known up front: convert and write strips in place concurrently.
+        std::atomic<bool> ok{true};
+        run(nStrips, [&](size_t s0, size_t s1) {
+            for (size_t s = s0; s < s1; ++s) {
+                uint32_t y0, y1;
+                stripRange(s, y0, y1);
+                PixelBuffer<uint8_t> buf(rowBytes * (y1 - y0));
+                rows(y0, y1, buf.data());
+                offsets[s] = static_cast<uint32_t>(end + y0 * rowBytes);
+                counts[s] = static_cast<uint32_t>(buf.size());
+                if (!f.writeAt(buf.data(), buf.size(), offsets[s])) ok = false;
+            }
+        });
+        if (!ok) return false;
+        end += rowBytes * height;
+    }
+#if defined(RAWPROC_HAVE_ZLIB)
+    else {
+        const int level = std::clamp(opt.level, 1, 9);
+        const size_t waveSize = 2 * (sched ? std::max<size_t>(1, sched->concurrency()) : 1);
+        for (size_t w0 = 0; w0 < nStrips; w0 += waveSize) {
+            std::vector<std::vector<uint8_t>> wave(std::min(waveSize, nStrips - w0));
+            std::atomic<bool> ok{true};
+            run(wave.size(), [&](size_t s0, size_t s1) {
+                for (size_t i = s0; i < s1; ++i) {
+                    uint32_t y0, y1;
+                    stripRange(w0 + i, y0, y1);
+                    PixelBuffer<uint8_t> buf(rowBytes * (y1 - y0));
+                    rows(y0, y1, buf.data());
+                    if (opt.predictor) {
+                        for (uint32_t y = 0; y < y1 - y0; ++y) differenceRow(buf.data() + y * rowBytes, samples, channels, bitDepth);
+                    }
+                    uLongf len = compressBound(static_cast<uLong>(buf.size()));
+                    wave[i].resize(len);
+                    if (compress2(wave[i].data(), &len, buf.data(), static_cast<uLong>(buf.size()), level) != Z_OK) ok = false;
+                    wave[i].resize(len);
+                }
+            });
+            if (!ok) return false;
+            for (size_t i = 0; i < wave.size(); ++i) {
+                if (end + wave[i].size() > std::numeric_limits<uint32_t>::max() - (1u << 16)) return false;
+                if (!f.writeAt(wave[i].data(), wave[i].size(), end)) return false;
+                offsets[w0 + i] = static_cast<uint32_t>(end);
+                counts[w0 + i] = static_cast<uint32_t>(wave[i].size());
+                end += wave[i].size();
+            }
+        }
+    }
+#endif
+
+    IfdBuilder ifd;
+    ifd.longs(256, {width});
+    ifd.longs(257, {height});
+    if (channels == 3) ifd.shorts(258, {static_cast<uint16_t>(bitDepth), static_cast<uint16_t>(bitDepth), static_cast<uint16_t>(bitDepth)});
+    else ifd.shorts(258, {static_cast<uint16_t>(bitDepth)});
+    ifd.shorts(259, {static_cast<uint16_t>(deflated ? 8 : 1)}); // Adobe Deflate / none
+    ifd.shorts(262, {static_cast<uint16_t>(channels == 3 ? 2 : 1)}); // RGB / BlackIsZero
+    ifd.longs(273, offsets);
+    ifd.shorts(277, {static_cast<uint16_t>(channels)});
+    ifd.longs(278, {stripRows});
+    ifd.longs(279, counts);
+    ifd.rational(282, 72, 1);
+    ifd.rational(283, 72, 1);
+    ifd.shorts(284, {1}); // chunky
+    ifd.shorts(296, {2}); // inch
+    if (deflated && opt.predictor) ifd.shorts(317, {2});
+
+    const uint32_t ifdAt = static_cast<uint32_t>((end + 1) & ~uint64_t(1));
+    const std::vector<uint8_t> dir = ifd.build(ifdAt);
+    std::vector<uint8_t> header = {'I', 'I'};
+    le16(header, 42);
+    le32(header, ifdAt);
+    if (!f.writeAt(dir.data(), dir.size(), ifdAt)) return false;
+    if (!f.writeAt(header.data(), header.size(), 0)) return false;
+    return f.close();
+}
+
+} // namespace rawproc
@@ -0,0 +1,116 @@
+#include "rawproc/TileTuner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace rawproc {
+
+int TileTuner::roundTileSize(int size) {
+    const int s = std::min(std::max(size, kMinTile), kMaxTile);
+    return std::max(kMinTile, s / kGranule * kGranule);
+}
+
+int TileTuner::frameSizeClass(const Inputs& in) {
+    uint64_t area = static_cast<uint64_t>(in.frameWidth) * in.frameHeight;
+    int c = 0;
+    while (area > 1) { area >>= 1; ++c; }
+    return c;
+}
+
+TileTuner::Shape TileTuner::shapeOf(const Inputs& in) {
+    return {std::max(0, in.apron), in.bytesPerPixel, std::max<size_t>(1, in.workers), frameSizeClass(in)};
+}
+
+int TileTuner::loadBalanceCap(const Inputs& in) {
+    if (!in.frameWidth || !in.frameHeight) return kMaxTile;
+    // At least four tiles per worker.
+    const double area = static_cast<double>(in.frameWidth) * in.frameHeight;
+    return roundTileSize(static_cast<int>(std::sqrt(area / (4.0 * static_cast<double>(std::max<size_t>(1, in.workers))))));
+}
+
+int TileTuner::modelTileSize(const Inputs& in) const {
+    const double apron = std::max(0, in.apron);
+    const double bpp = static_cast<double>(std::max<size_t>(1, in.bytesPerPixel));
+    const double stageBpp = std::min(bpp, static_cast<double>(std::max<size_t>(1, in.stageBytesPerPixel)));
+    // Working sets (size + 2 * apron)^2 * bytes per pixel within half a cache share; the apron
+    // is counted at the full per-pixel cost, which keeps the estimate on the safe side.
+    auto fits = [&](size_t cache, double bytes) {
+        return std::sqrt(0.5 * static_cast<double>(cache) / bytes) - 2.0 * apron;
+    };
+    double size = std::min(fits(caches_.l2PerCpu(), stageBpp), fits(caches_.l3PerCpu(), bpp));
+    // Inner area at least 75% of the processed area: size >= 2a / (1 / sqrt(0.75) - 1).
+    size = std::max(size, 2.0 * apron / (1.0 / std::sqrt(0.75) - 1.0));
+    return std::min(roundTileSize(static_cast<int>(size)), loadBalanceCap(in));
+}
+
+int TileTuner::tileSize(const Inputs& in) const {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        auto it = calibrated_.find(shapeOf(in));
+        if (it != calibrated_.end()) return std::min(it->second, loadBalanceCap(in));
+    }
+    return modelTileSize(in);
+}
+
+void TileTuner::setCalibrated(const Inputs& in, int tileSize) {
+    std::lock_guard<std::mutex> lk(m_);
+    calibrated_[shapeOf(in)] = std::min(roundTileSize(tileSize), loadBalanceCap(in));
+}
+
+bool TileTuner::hasCalibration(const Inputs& in) const {
+    std::lock_guard<std::mutex> lk(m_);
+    return calibrated_.count(shapeOf(in)) != 0;
+}
+
+std::string TileTuner::machineKey() const {
+    std::ostringstream s;
+    s << "cpus" << std::max(1u, std::thread::hardware_concurrency()) << "-l2-" << caches_.l2 << 'x' << caches_.l2SharedBy
+      << "-l3-" << caches_.l3 << 'x' << caches_.l3SharedBy;
+    return s.str();
+}
+
+bool TileTuner::load(const std::filesystem::path& path) {
+    std::ifstream f(path);
+    if (!f) return false;
+    const std::string machine = machineKey();
+    std::string line;
+    std::lock_guard<std::mutex> lk(m_);
+    while (std::getline(f, line)) {
+        std::istringstream s(line);
+        std::string key;
+        int apron = 0, sizeClass = 0, size = 0;
+        size_t bpp = 0, workers = 0;
+        if (!(s >> key >> apron >> bpp >> workers >> sizeClass >> size) || key != machine || size <= 0) continue;
+        calibrated_[Shape{apron, bpp, workers, sizeClass}] = roundTileSize(size);
+    }
+    return true;
+}
+
+bool TileTuner::save(const std::filesystem::path& path) const {
+    const std::string machine = machineKey();
+    std::vector<std::string> keep;
+    {
+        std::ifstream f(path);
+        std::string line;
+        while (f && std::getline(f, line)) {
+            if (!line.empty() && line.compare(0, line.find(' '), machine) != 0) keep.push_back(line);
+        }
+    }
+    std::error_code ec;
+    if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), ec);
+    std::ofstream f(path, std::ios::trunc);
+    if (!f) return false;
+    for (const auto& line : keep) f << line << '\n';
+    std::lock_guard<std::mutex> lk(m_);
+    for (const auto& [shape, size] : calibrated_) {
+        f << machine << ' ' << std::get<0>(shape) << ' ' << std::get<1>(shape) << ' ' << std::get<2>(shape) << ' '
+          << std::get<3>(shape) << ' ' << size << '\n';
+    }
+    return static_cast<bool>(f);
+}
+
+} // namespace rawproc
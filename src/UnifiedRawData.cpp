@@ -1,2 +1,34 @@
 #include "rawproc/UnifiedRawData.h"
-// Intentionally empty: header-only data containers.
+
+#include <cstring>
+
+namespace rawproc {
+
+uint64_t hashRawContent(const RawImage& raw) {
+    // Four independent multiply-xorshift lanes over 8-byte words keep the multiplier pipeline
+    // busy; rows are hashed separately so views with a stride hash like their compact copies.
+    constexpr uint64_t kMul = 0x9E3779B97F4A7C15ull;
+    uint64_t lane[4] = {raw.width, raw.height, 0x243F6A8885A308D3ull, 0x13198A2E03707344ull};
+    auto mix = [](uint64_t h, uint64_t v) {
+        h = (h ^ v) * kMul;
+        return h ^ (h >> 29);
+    };
+    for (uint32_t y = 0; y < raw.height; ++y) {
+        const uint16_t* row = raw.row(y);
+        uint32_t x = 0;
+        for (; x + 16 <= raw.width; x += 16) {
+            for (int k = 0; k < 4; ++k) {
+                uint64_t v;
+                std::memcpy(&v, row + x + 4 * k, sizeof(v));
+                lane[k] = mix(lane[k], v);
+            }
+        }
+        for (; x < raw.width; ++x) lane[x & 3] = mix(lane[x & 3], row[x]);
+        lane[0] = mix(lane[0], y);
+    }
+    uint64_t h = lane[0];
+    for (int k = 1; k < 4; ++k) h = mix(h, lane[k]);
+    return h ? h : 1;
+}
+
+} // namespace rawproc
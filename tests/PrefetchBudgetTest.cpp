@@ -0,0 +1,87 @@
+// Prefetches dropped by clearPrefetched() or evicted for room must hand their reservation and
+// their pixels back: with a budget of a few images, a long run of prefetches has to keep making
+// progress and stay within a bounded footprint. A prefetch claimed while still queued must
+// still be decoded for the claim.
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "rawproc/RawLoader.h"
+
+using namespace rawproc;
+
+namespace {
+
+// Resident set size in KiB, 0 where /proc is not available.
+long residentKb() {
+    std::ifstream f("/proc/self/status");
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) return std::stol(line.substr(6));
+    }
+    return 0;
+}
+
+bool loadsWithin(RawLoader& loader, const std::string& path, std::chrono::seconds timeout) {
+    auto fut = loader.loadAsync(path);
+    if (fut.wait_for(timeout) != std::future_status::ready) return false;
+    return fut.get().has_value();
+}
+
+// loadAsync() takes over a prefetch that has not started yet and drops its own reference to it.
+bool claimsQueuedPrefetch() {
+    for (int run = 0; run < 10; ++run) {
+        RawLoader loader;
+        loader.setDecodeThreads(1);
+        for (int i = 0; i < 20; ++i) loader.prefetch("f" + std::to_string(i) + ".raw");
+        auto fut = loader.loadAsync("f19.raw");
+        if (fut.wait_for(std::chrono::seconds(30)) != std::future_status::ready || !fut.get()) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+#if defined(RAWPROC_HAVE_LIBRAW)
+    return 77; // needs the placeholder decoder (640x480 images without a file)
+#else
+    const size_t imageBytes = 640 * 480 * sizeof(uint16_t);
+    RawLoader loader;
+    loader.setMemoryBudget(4 * imageBytes);
+    if (!loadsWithin(loader, "warmup.raw", std::chrono::seconds(10))) {
+        std::fprintf(stderr, "warm-up load failed\n");
+        return 1;
+    }
+    if (!claimsQueuedPrefetch()) {
+        std::fprintf(stderr, "loadAsync of a queued prefetch returned no image\n");
+        return 1;
+    }
+    const long before = residentKb();
+
+    // Dropped while queued, running or finished.
+    for (int i = 0; i < 300; ++i) {
+        loader.prefetch("drop" + std::to_string(i) + ".raw");
+        if (i % 10 == 9) loader.clearPrefetched();
+    }
+    loader.clearPrefetched();
+    // Evicted to make room for later ones.
+    for (int i = 0; i < 100; ++i) loader.prefetch("evict" + std::to_string(i) + ".raw");
+
+    // A leaked reservation blocks every later decode once the budget is used up.
+    if (!loadsWithin(loader, "last.raw", std::chrono::seconds(30))) {
+        std::fprintf(stderr, "decode blocked: prefetch reservations were not released\n");
+        return 1;
+    }
+    loader.clearPrefetched();
+    const long after = residentKb();
+    // 400 leaked images would be ~240 MB; the budget allows a handful.
+    const long limitKb = static_cast<long>(16 * imageBytes / 1024);
+    if (before && after - before > limitKb) {
+        std::fprintf(stderr, "resident set grew by %ld KiB (limit %ld KiB)\n", after - before, limitKb);
+        return 1;
+    }
+    return 0;
+#endif
+}
@@ -0,0 +1,61 @@
+// Undoing a parameter change must render from the tiles cached for the earlier state instead of
+// re-rendering them.
+#include <cstdio>
+#include <vector>
+
+#include "rawproc/PluginManager.h"
+#include "rawproc/ProcessingPipeline.h"
+
+using namespace rawproc;
+
+int main() {
+    PluginManager pm;
+    pm.scanDirectory(RAWPROC_RUNTIME_PLUGIN_DIR);
+    PluginManager::InstanceId gammaId = 0;
+    const auto& protos = pm.prototypes();
+    for (size_t i = 0; i < protos.size(); ++i) {
+        if (protos[i].name == "Gamma") gammaId = pm.createInstance(i);
+    }
+    if (!gammaId) {
+        std::fprintf(stderr, "Gamma plugin not found in %s\n", RAWPROC_RUNTIME_PLUGIN_DIR);
+        return 1;
+    }
+    auto gamma = pm.getInstance(gammaId);
+
+    UnifiedRawData data;
+    data.raw.width = 300;
+    data.raw.height = 200;
+    data.raw.data.resize(static_cast<size_t>(data.raw.width) * data.raw.height);
+    for (size_t i = 0; i < data.raw.data.size(); ++i) data.raw.data[i] = static_cast<uint16_t>((i * 37) % 4096);
+    data.meta.white_level = 4095;
+    data.sourceHash = hashRawContent(data.raw);
+    data.history.push_back({gammaId});
+
+    ProcessingPipeline pipeline(pm);
+    RenderRequest req;
+    req.tileSize = 64;
+
+    gamma->setParameter("Gamma", ParamValue(2.2f));
+    const std::vector<RgbTile> first = pipeline.applyTileList(data, req);
+    gamma->setParameter("Gamma", ParamValue(1.6f));
+    const std::vector<RgbTile> edited = pipeline.applyTileList(data, req);
+    gamma->setParameter("Gamma", ParamValue(2.2f)); // undo
+    const std::vector<RgbTile> undone = pipeline.applyTileList(data, req);
+
+    if (first.empty() || first.size() != edited.size() || first.size() != undone.size()) {
+        std::fprintf(stderr, "tile counts differ: %zu %zu %zu\n", first.size(), edited.size(), undone.size());
+        return 1;
+    }
+    int failures = 0;
+    for (size_t i = 0; i < first.size(); ++i) {
+        if (edited[i].data == first[i].data) {
+            std::fprintf(stderr, "tile %zu: edited state reused the old tile\n", i);
+            ++failures;
+        }
+        if (undone[i].data != first[i].data) {
+            std::fprintf(stderr, "tile %zu: not reused after undo\n", i);
+            ++failures;
+        }
+    }
+    return failures ? 1 : 0;
+}